@@ -6,13 +6,54 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include "backing_store.h"
+#include "output.h"
+#include "replay.h"
+#include "interpreter.h"
 
 #define BACKING_STORE_DIR "backing_store"
-#define MAX_LINE_LENGTH 1000
+#define COPY_BLOCK_SIZE 8192 // Size of blocks used when copying scripts into the store
+#define MAX_KEYWORD_LEN 5     // Length of the longest control statement keyword (see flow_keyword)
+
+struct line_buffer // Buffer page lines are read into, kept between page loads (grows to the longest line read)
+{
+    char *data;
+    size_t size;
+} page_line = {NULL, 0};
+
+struct line_head // First word of the line being copied, kept while it can still be a control statement keyword
+{
+    char word[MAX_KEYWORD_LEN];
+    int len;     // Number of characters of the word seen so far (MAX_KEYWORD_LEN + 1 once it is too long)
+    int started; // Indicator (1 once leading whitespace was skipped)
+    int ended;   // Indicator (1 once the word ended)
+};
+
+struct flow_marks // Growable list of the control statements of a script
+{
+    struct flow_mark *data;
+    int n;
+    int cap;
+};
+
+struct script_lines // Growable list of the compiled lines of a script, built while it is copied
+{
+    struct parsed_line **data;
+    int n;
+    int cap;
+    struct line_buffer text; // Text of the line being copied (it may span several blocks)
+    size_t len;              // Length of text
+};
 
 void error_copy_failed();
 void error_read_from_store_failed();
+const char *scan_line_head(struct line_head *h, const char *p, const char *end);
+int end_line_head(struct line_head *h, int line, struct flow_marks *marks);
+flow_kind_t line_head_kind(struct line_head *h);
+int add_line_text(struct script_lines *l, const char *p, size_t len);
+int end_line(struct script_lines *l);
+void free_script_lines(struct script_lines *l);
 
 /*
  * Function:  clear_backing_store
@@ -60,7 +101,7 @@ void init_backing_store()
  */
 void error_copy_failed()
 {
-    printf("An error occured while trying to copy script contents to backing store\n");
+    out_printf("An error occured while trying to copy script contents to backing store\n");
 }
 
 /*
@@ -71,67 +112,398 @@ void error_copy_failed()
  */
 void error_read_from_store_failed()
 {
-    printf("An error occured while attempting to read data from the backing store into main menu\n");
+    out_printf("An error occured while attempting to read data from the backing store into main menu\n");
+}
+
+/*
+ * Function:  count_script_lines
+ * --------------------
+ * Counts the lines of a script without copying it (an empty script counts as a single blank line, see cp_to_store)
+ *
+ * const char *filename: name of script
+ *
+ * returns (int): number of lines in file (-1 on failure)
+ */
+int count_script_lines(const char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        return -1;
+
+    char block[COPY_BLOCK_SIZE];
+    ssize_t n_read;
+    long total = 0;
+    int n_lines = 0;
+    char last = '\n';
+
+    while ((n_read = read(fd, block, sizeof(block))) > 0)
+    {
+        char *nl = block;
+        while ((nl = memchr(nl, '\n', block + n_read - nl)) != NULL)
+        {
+            nl++;
+            n_lines++;
+        }
+        total += n_read;
+        last = block[n_read - 1];
+    }
+
+    close(fd);
+
+    if (n_read == -1)
+        return -1;
+
+    if (total == 0 || last != '\n')
+        n_lines++; // Empty script, or last line has no trailing newline
+
+    return n_lines;
+}
+
+/*
+ * Function:  scan_line_head
+ * --------------------
+ * Reads the first word of a line (as the tokenizer splits it) as long as it can be a control statement keyword.
+ * Only the first few characters of each line are looked at.
+ *
+ * struct line_head *h: first word of the line so far
+ * const char *p: next character of the line
+ * const char *end: end of the available characters (the line may continue in the next block)
+ *
+ * returns (const char *): character after the last one used
+ */
+const char *scan_line_head(struct line_head *h, const char *p, const char *end)
+{
+    while (!h->ended && p < end)
+    {
+        char c = *p;
+        if (!h->started)
+        {
+            if (c == ' ' || c == '\t')
+            {
+                p++;
+                continue;
+            }
+            h->started = 1;
+        }
+
+        if (c == ' ' || c == '\n' || c == ';' || c == '|' || c == '\0' || h->len > MAX_KEYWORD_LEN)
+        {
+            h->ended = 1;
+            break;
+        }
+        if (h->len < MAX_KEYWORD_LEN)
+            h->word[h->len] = c;
+        h->len++;
+        p++;
+    }
+    return p;
+}
+
+/*
+ * Function:  end_line_head
+ * --------------------
+ * Records the line whose first word was read if it is a control statement, then resets the first word for the next line
+ *
+ * struct line_head *h: first word of the line
+ * int line: index of the line
+ * struct flow_marks *marks: control statements found so far
+ *
+ * returns (int): Indicator (1 on success, 0 if out of memory)
+ */
+int end_line_head(struct line_head *h, int line, struct flow_marks *marks)
+{
+    flow_kind_t kind = line_head_kind(h);
+    h->len = 0;
+    h->started = 0;
+    h->ended = 0;
+
+    if (kind == FLOW_NONE)
+        return 1;
+
+    if (marks->n == marks->cap)
+    {
+        int new_cap = marks->cap == 0 ? 8 : marks->cap * 2;
+        struct flow_mark *grown = realloc(marks->data, new_cap * sizeof(struct flow_mark));
+        if (grown == NULL)
+            return 0;
+        marks->data = grown;
+        marks->cap = new_cap;
+    }
+    marks->data[marks->n].line = line;
+    marks->data[marks->n].kind = kind;
+    marks->n++;
+    return 1;
+}
+
+/*
+ * Function:  line_head_kind
+ * --------------------
+ * returns (flow_kind_t): kind of control statement the first word of a line is the keyword of (FLOW_NONE if none)
+ */
+flow_kind_t line_head_kind(struct line_head *h)
+{
+    return h->len <= MAX_KEYWORD_LEN ? flow_keyword(h->word, h->len) : FLOW_NONE;
+}
+
+/*
+ * Function:  line_flow_kind
+ * --------------------
+ * Recognizes a control statement like cp_to_store does, for scripts that are read without being copied (see simulate)
+ *
+ * const char *line: line of text (with or without its newline)
+ * const char *end: end of the line
+ *
+ * returns (flow_kind_t): kind of control statement, FLOW_NONE if the line is not one
+ */
+flow_kind_t line_flow_kind(const char *line, const char *end)
+{
+    struct line_head head = {{0}, 0, 0, 0};
+    scan_line_head(&head, line, end);
+    return line_head_kind(&head);
 }
 
 /*
  * Function:  cp_to_store
  * --------------------
- * Attempts to copy given file (given relative to current directory) into backing store
+ * Attempts to copy given file (given relative to current directory) into backing store.
+ * While copying, records the byte offset at which every page (FRAMESIZE lines) starts, so that pages can later be
+ * loaded with a single seek instead of scanning the file from the beginning, and the lines that are control
+ * statements (their first word is a keyword, see flow_keyword), so they can be compiled without reading the script again.
+ * Every line is also compiled (see parse_line) in the same pass: pages are loaded from the compiled lines, the copy
+ * is only read again for the text of pages (see load_into_mem).
+ *
+ * An empty script is stored as a single blank line.
  *
  * const char *filename: name of script to copy
  * p_t pid: process id of process script is being copied for (used for filename in backing store)
+ * long **page_offsets: set to a malloc'd array containing the start offset of each page (must be freed by caller)
+ * struct flow_mark **flow_marks: set to a malloc'd array of the control statements in line order (must be freed by caller)
+ * int *n_flow_marks: set to the number of control statements
+ * struct parsed_line ***lines: set to a malloc'd array of the compiled lines, each holding one reference (must be
+ *                              released and freed by caller)
+ * unsigned int *checksum: set to the checksum of the script (see log_checksum), NULL if not needed
  *
  * returns (int): number of lines in copied file (-1 on failure)
  */
-int cp_to_store(const char *filename, p_t pid)
+int cp_to_store(const char *filename, p_t pid, long **page_offsets, struct flow_mark **flow_marks, int *n_flow_marks,
+                struct parsed_line ***lines, unsigned int *checksum)
 {
     char backing_file_name[500];
 
     sprintf(backing_file_name, "%s/%llu.process", BACKING_STORE_DIR, pid);
 
-    if (access(filename, F_OK) == -1)
+    FILE *read_file = fopen(filename, "rb");
+    if (read_file == NULL)
     {
         // File to copy not found
         error_copy_failed();
         return -1;
     }
 
-    if (access(backing_file_name, F_OK) == 0)
+    int write_fd = open(backing_file_name, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (write_fd == -1)
     {
-        // Backing store already contains a script with given pid
+        // Backing store already contains a script with given pid (or store is unavailable)
+        fclose(read_file);
         error_copy_failed();
         return -1;
     }
 
-    FILE *read_file = fopen(filename, "rt");
-    FILE *write_file = fopen(backing_file_name, "wt");
+    int offsets_cap = 4;
+    long *offsets = malloc(offsets_cap * sizeof(long));
+    if (offsets == NULL)
+    {
+        fclose(read_file);
+        close(write_fd);
+        return -1;
+    }
+    offsets[0] = 0;
 
-    // Copy file
-    char c;
+    // Copy file in blocks, counting lines and reading the first word of each line as we go
+    char block[COPY_BLOCK_SIZE];
+    size_t n_read;
+    long total = 0;
     int n_lines = 0;
+    char last = '\n';
+    struct line_head head = {{0}, 0, 0, 0};
+    struct flow_marks marks = {NULL, 0, 0};
+    struct script_lines compiled = {NULL, 0, 0, {NULL, 0}, 0};
+
+    if (checksum != NULL)
+        *checksum = LOG_CHECKSUM_INIT;
 
-    while ((c = fgetc(read_file)) != EOF)
+    while ((n_read = fread(block, 1, sizeof(block), read_file)) > 0)
     {
-        if (c == '\n')
+        if (checksum != NULL)
+            *checksum = log_checksum(*checksum, block, n_read);
+        if (write(write_fd, block, n_read) != (ssize_t)n_read)
         {
+            free(offsets);
+            free(marks.data);
+            free_script_lines(&compiled);
+            fclose(read_file);
+            close(write_fd);
+            error_copy_failed();
+            return -1;
+        }
+
+        const char *end = block + n_read;
+        const char *line = block; // Start of the rest of the current line in this block
+        const char *nl = scan_line_head(&head, block, end);
+        while ((nl = memchr(nl, '\n', end - nl)) != NULL)
+        {
+            if (!end_line_head(&head, n_lines, &marks) || !add_line_text(&compiled, line, nl + 1 - line) ||
+                !end_line(&compiled))
+            {
+                free(offsets);
+                free(marks.data);
+                free_script_lines(&compiled);
+                fclose(read_file);
+                close(write_fd);
+                return -1;
+            }
+
+            nl++;
+            line = nl;
             n_lines++;
+            if (n_lines % FRAMESIZE == 0)
+            {
+                int page = n_lines / FRAMESIZE;
+                if (page >= offsets_cap)
+                {
+                    offsets_cap *= 2;
+                    long *grown = realloc(offsets, offsets_cap * sizeof(long));
+                    if (grown == NULL)
+                    {
+                        free(offsets);
+                        free(marks.data);
+                        free_script_lines(&compiled);
+                        fclose(read_file);
+                        close(write_fd);
+                        return -1;
+                    }
+                    offsets = grown;
+                }
+                offsets[page] = total + (nl - block);
+            }
+            nl = scan_line_head(&head, nl, end);
+        }
+        if (!add_line_text(&compiled, line, end - line))
+        {
+            free(offsets);
+            free(marks.data);
+            free_script_lines(&compiled);
+            fclose(read_file);
+            close(write_fd);
+            return -1;
         }
-        fputc(c, write_file);
+
+        total += n_read;
+        last = block[n_read - 1];
     }
 
-    fseek(read_file, -1L, SEEK_END);
-    if (fgetc(read_file) != '\n')
+    if (total == 0)
+    {
+        // Empty script, store a single blank line
+        if (write(write_fd, "\n", 1) != 1)
+            error_copy_failed();
+    }
+    if (total == 0 || last != '\n')
     {
+        // Blank line of an empty script, or last line without trailing newline (compiled as if it had one, like
+        // load_into_mem reads it)
+        if ((total != 0 && !end_line_head(&head, n_lines, &marks)) || !add_line_text(&compiled, "\n", 1) ||
+            !end_line(&compiled))
+        {
+            free(offsets);
+            free(marks.data);
+            free_script_lines(&compiled);
+            fclose(read_file);
+            close(write_fd);
+            return -1;
+        }
         n_lines++;
     }
 
     fclose(read_file);
-    fclose(write_file);
+    close(write_fd);
+    free(compiled.text.data);
 
+    *page_offsets = offsets;
+    *flow_marks = marks.data;
+    *n_flow_marks = marks.n;
+    *lines = compiled.data;
     return n_lines;
 }
 
+/*
+ * Function:  add_line_text
+ * --------------------
+ * Appends text to the line being copied
+ *
+ * struct script_lines *l: compiled lines
+ * const char *p: text
+ * size_t len: length of text
+ *
+ * returns (int): Indicator (1 on success, 0 if out of memory)
+ */
+int add_line_text(struct script_lines *l, const char *p, size_t len)
+{
+    if (l->len + len + 1 > l->text.size)
+    {
+        size_t new_size = l->text.size == 0 ? 128 : l->text.size;
+        while (l->len + len + 1 > new_size)
+            new_size *= 2;
+        char *grown = realloc(l->text.data, new_size);
+        if (grown == NULL)
+            return 0;
+        l->text.data = grown;
+        l->text.size = new_size;
+    }
+    memcpy(l->text.data + l->len, p, len);
+    l->len += len;
+    l->text.data[l->len] = '\0';
+    return 1;
+}
+
+/*
+ * Function:  end_line
+ * --------------------
+ * Compiles the line being copied (its text ends with its newline) and starts the next one
+ *
+ * struct script_lines *l: compiled lines
+ *
+ * returns (int): Indicator (1 on success, 0 if out of memory)
+ */
+int end_line(struct script_lines *l)
+{
+    if (l->n == l->cap)
+    {
+        int new_cap = l->cap == 0 ? 64 : l->cap * 2;
+        struct parsed_line **grown = realloc(l->data, new_cap * sizeof(struct parsed_line *));
+        if (grown == NULL)
+            return 0;
+        l->data = grown;
+        l->cap = new_cap;
+    }
+    l->data[l->n++] = parse_line(l->text.data);
+    l->len = 0;
+    return 1;
+}
+
+/*
+ * Function:  free_script_lines
+ * --------------------
+ * Frees the lines compiled so far (copy failed)
+ */
+void free_script_lines(struct script_lines *l)
+{
+    for (int i = 0; i < l->n; i++)
+        release_line(l->data[i]);
+    free(l->data);
+    free(l->text.data);
+}
+
 /*
  * Function:  remove_process_store
  * --------------------
@@ -145,13 +517,10 @@ void remove_process_store(struct pcb *pcb)
     char backing_file_name[500];
     sprintf(backing_file_name, "%s/%llu.process", BACKING_STORE_DIR, pcb->pid);
 
-    if (access(backing_file_name, F_OK) == -1)
+    if (remove(backing_file_name) != 0)
     {
         error_read_from_store_failed(); // File trying to delete doesn't exist (but is expected to)
-        return;
     }
-
-    remove(backing_file_name);
 }
 
 /*
@@ -160,7 +529,7 @@ void remove_process_store(struct pcb *pcb)
  * Loads up to FRAMESIZE lines from backing store into main memory
  *
  * struct pcb *pcb: pcb of process to read from
- * int start: line to start reading from
+ * int start: line to start reading from (must be the first line of a page)
  * char **mem_loc[]: array of shell memory locations to write lines into
  *
  */
@@ -170,12 +539,6 @@ void load_into_mem(struct pcb *pcb, int start, char **mem_loc[])
 
     sprintf(backing_file_name, "%s/%llu.process", BACKING_STORE_DIR, pcb->pid);
 
-    if (access(backing_file_name, F_OK) == -1)
-    {
-        error_read_from_store_failed();
-        return;
-    }
-
     FILE *process_file = fopen(backing_file_name, "rt");
 
     if (process_file == NULL)
@@ -184,22 +547,12 @@ void load_into_mem(struct pcb *pcb, int start, char **mem_loc[])
         return;
     }
 
-    int cur_line = 0;
-    char c = 'a'; // Character not used (but needs initialization because otherwise could == EOF by chance)
-
-    // Move file pointer to current pcb location
-    while (cur_line < start && (c = fgetc(process_file)) != EOF)
-    {
-        if (c == '\n')
-        {
-            cur_line++;
-        }
-    }
-
-    if (c == EOF)
+    // Move file pointer to the start of the page (offsets recorded by cp_to_store)
+    if (start >= pcb->bound || fseek(process_file, pcb->page_offsets[start / FRAMESIZE], SEEK_SET) != 0)
     {
         // less than "start" lines exist in file, cannot read from "start" line onwards
         error_read_from_store_failed();
+        fclose(process_file);
         return;
     }
 
@@ -209,26 +562,21 @@ void load_into_mem(struct pcb *pcb, int start, char **mem_loc[])
         n_lines = pcb->bound - start; // if near end of file, read remaining lines
     }
 
-    size_t buffer_size = MAX_LINE_LENGTH;
-
-    char *buffer = (char *)malloc(buffer_size * sizeof(char));
-    if (buffer == NULL)
-        return;
-
-    if (pcb->pc + n_lines > pcb->bound)
-    {
-        return; // Extra check
-    }
-
     // write instructions from file directly into memory locations
     // mem locations passed as an array of char**
     for (int i = 0; i < n_lines; ++i)
     {
-        buffer_size = MAX_LINE_LENGTH;
-        getline(&buffer, &buffer_size, process_file);
+        ssize_t len = getline(&page_line.data, &page_line.size, process_file); // Lines can have any length
+        if (len == -1)
+            len = 0;
         if (*mem_loc[i] != NULL) // Clear memory if already in use (I don't think this will ever be the case)
             free(*mem_loc[i]);
-        *(mem_loc[i]) = strdup(buffer);
+        *(mem_loc[i]) = malloc(len + 1);
+        if (*(mem_loc[i]) != NULL)
+        {
+            memcpy(*(mem_loc[i]), page_line.data, len);
+            (*(mem_loc[i]))[len] = '\0';
+        }
     }
 
     // Clear extra lines
@@ -239,6 +587,5 @@ void load_into_mem(struct pcb *pcb, int start, char **mem_loc[])
         *(mem_loc[i]) = NULL;
     }
 
-    free(buffer);
     fclose(process_file);
-}
\ No newline at end of file
+}
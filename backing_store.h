@@ -4,10 +4,15 @@
 #include <stdio.h>
 #include "pcb.h"
 
+struct parsed_line; // Compiled script line (see parse_line)
+
 void init_backing_store();
-int cp_to_store(const char *filename, p_t pid);
+int count_script_lines(const char *filename);
+int cp_to_store(const char *filename, p_t pid, long **page_offsets, struct flow_mark **flow_marks, int *n_flow_marks,
+                struct parsed_line ***lines, unsigned int *checksum);
 void load_into_mem(struct pcb *pcb, int n, char **mem_loc[]);
 void clear_backing_store();
 void remove_process_store(struct pcb *pcb);
+flow_kind_t line_flow_kind(const char *line, const char *end);
 
 #endif
\ No newline at end of file
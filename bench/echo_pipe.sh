@@ -0,0 +1,42 @@
+#!/bin/bash
+# Benchmark: output-heavy script writing to a pipe.
+#
+# Usage: bench/echo_pipe.sh [n_lines] [mysh...]
+#
+# Generates a script of n_lines echo/print commands and times "mysh SCRIPT | cat > /dev/null" (batch mode) for each
+# given mysh binary (default: ./mysh). To compare output buffer sizes, build copies with e.g.
+# "make mysh outbufsize=4096 && cp mysh /tmp/mysh_4k" and pass them as arguments.
+
+N=${1:-200000}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BINARIES="$ROOT/mysh"
+if [ $# -gt 1 ]; then
+	shift
+	BINARIES="$*"
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Mostly echo, with some variable lookups so print/echo $VAR are covered as well
+awk -v n="$N" 'BEGIN {
+	print "set greeting hello world"
+	for (i = 1; i < n; i++) {
+		if (i % 4 == 0) print "echo $greeting"
+		else if (i % 4 == 1) print "print greeting"
+		else print "echo line" i
+	}
+}' > "$WORK/echo.txt"
+
+echo "lines=$N"
+for mysh in $BINARIES; do
+	if [ ! -x "$mysh" ]; then
+		echo "$mysh not found, run make first" >&2
+		exit 1
+	fi
+	start=$(date +%s%N)
+	(cd "$WORK" && "$mysh" echo.txt | cat > /dev/null)
+	end=$(date +%s%N)
+	awk -v b="$mysh" -v s="$start" -v e="$end" -v n="$N" \
+		'BEGIN { t = (e - s) / 1e9; printf "%-40s %.3f s  %.0f lines/s\n", b, t, n / t }'
+done
@@ -0,0 +1,44 @@
+#!/bin/bash
+# Benchmark: launch many small scripts with a single exec call.
+#
+# Usage: bench/exec_many.sh [n_scripts] [lines_per_script] [policy...]
+#
+# Generates n_scripts small scripts (and a manifest listing them) in a temporary directory, then times
+# "exec -f manifest POLICY" for each policy. Shell output is discarded, only timings are printed.
+# The mysh binary must already be built (run make first).
+
+N=${1:-10000}
+LINES=${2:-3}
+POLICIES="FCFS SJF RR AGING"
+if [ $# -gt 2 ]; then
+	shift 2
+	POLICIES="$*"
+fi
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+MYSH="$ROOT/mysh"
+
+if [ ! -x "$MYSH" ]; then
+	echo "mysh not found, run make first" >&2
+	exit 1
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Scripts get different lengths so SJF/AGING have something to sort
+for ((i = 0; i < N; i++)); do
+	n=$((LINES + i % 3))
+	for ((j = 0; j < n; j++)); do
+		echo "set v$((j % 3)) $i"
+	done >"$WORK/s$i.txt"
+	echo "s$i.txt"
+done >"$WORK/manifest.txt"
+
+echo "scripts=$N lines_per_script=$LINES"
+for policy in $POLICIES; do
+	start=$(date +%s.%N)
+	(cd "$WORK" && printf 'exec -f manifest.txt %s\nquit\n' "$policy" | "$MYSH" >/dev/null)
+	end=$(date +%s.%N)
+	awk -v p="$policy" -v s="$start" -v e="$end" 'BEGIN { printf "%-6s %.3f s\n", p, e - s }'
+done
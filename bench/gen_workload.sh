@@ -0,0 +1,95 @@
+#!/bin/bash
+# Synthetic workload generator: script families for paging and scheduling stress, and exec manifests combining them.
+#
+# Usage: bench/gen_workload.sh DIR [scripts_per_family] [SPEC]
+#
+# Writes into DIR (created if needed), for every family of SPEC:
+#   FAMILY_I.txt        the scripts of the family (I = 0..scripts_per_family-1, default 20)
+#   FAMILY.manifest     exec manifest listing them (exec -f FAMILY.manifest POLICY)
+# and mix.manifest, which interleaves the scripts of every family.
+#
+# SPEC is a file with one family per line (default: the families below), '#' starts a comment:
+#   NAME LENGTH LOOP_BODY ITERS VARS ECHO_PCT
+#     LENGTH     lines of the script (scripts of a family vary from LENGTH/2 to 3*LENGTH/2, so SJF/AGING have
+#                something to order)
+#     LOOP_BODY  lines of a for loop body run ITERS times (0: straight-line script). A body larger than the frame
+#                store has no locality, one that fits in a few frames runs from resident pages
+#     VARS       number of distinct variables set (variable churn against the variable store size)
+#     ECHO_PCT   percentage of lines that print (output volume), the other lines set variables
+#
+# Scripts are generated deterministically (SEED environment variable, default 1), so runs can be compared.
+
+DEFAULT_SPEC='
+# name     length loop_body iters vars echo_pct
+straight   60     0         0     4    10
+loop       12     6         20    4    10
+bigloop    40     30        5     4    10
+churn      40     0         0     32   0
+chatty     40     0         0     2    90
+'
+
+DIR=$1
+N=${2:-20}
+SPEC=$3
+SEED=${SEED:-1}
+
+if [ -z "$DIR" ]; then
+	echo "Usage: $0 DIR [scripts_per_family] [SPEC]" >&2
+	exit 1
+fi
+mkdir -p "$DIR" || exit 1
+
+if [ -n "$SPEC" ]; then
+	SPEC_TEXT=$(cat "$SPEC") || exit 1
+else
+	SPEC_TEXT=$DEFAULT_SPEC
+fi
+
+echo "$SPEC_TEXT" | awk -v dir="$DIR" -v n="$N" -v seed="$SEED" '
+function line(family_vars, echo_pct) {
+	if (rand() * 100 < echo_pct)
+		return "echo out" int(rand() * 1000)
+	return "set v" int(rand() * family_vars) " " int(rand() * 1000)
+}
+{ sub(/#.*/, "") }
+NF == 0 { next }
+NF != 6 { print "bad family spec: " $0 > "/dev/stderr"; exit 1 }
+{
+	name = $1; length_ = $2; body = $3; iters = $4; vars = $5 > 0 ? $5 : 1; echo_pct = $6
+	families[n_families++] = name
+	srand(seed + n_families)
+	manifest = dir "/" name ".manifest"
+	printf "" > manifest
+	for (i = 0; i < n; i++) {
+		file = dir "/" name "_" i ".txt"
+		lines = int(length_ / 2 + (i * length_) / (n > 1 ? n - 1 : 1)) # LENGTH/2 .. 3*LENGTH/2
+		if (lines < 1) lines = 1
+		loop_lines = body > 0 && iters > 0 ? body + 2 : 0
+		if (loop_lines > lines) loop_lines = body + 2 # The loop is kept whole
+		before = int((lines - loop_lines) / 2)
+		if (before < 0) before = 0
+		after = lines - loop_lines - before
+		printf "" > file
+		for (j = 0; j < before; j++) print line(vars, echo_pct) > file
+		if (loop_lines > 0) {
+			print "for it in 1.." iters > file
+			for (j = 0; j < body; j++) print "  " line(vars, echo_pct) > file
+			print "done" > file
+		}
+		for (j = 0; j < after; j++) print line(vars, echo_pct) > file
+		close(file)
+		print name "_" i ".txt" > manifest
+	}
+	close(manifest)
+}
+END {
+	mix = dir "/mix.manifest"
+	printf "" > mix
+	for (i = 0; i < n; i++)
+		for (f = 0; f < n_families; f++)
+			print families[f] "_" i ".txt" > mix
+}' || exit 1
+
+for manifest in "$DIR"/*.manifest; do
+	echo "$(basename "$manifest" .manifest): $(wc -l <"$manifest") scripts"
+done
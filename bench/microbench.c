@@ -0,0 +1,354 @@
+/*
+ * Microbenchmarks of the shell's hot paths, each timed in isolation: instruction reads (resident page and page fault),
+ * page loads from the backing store, the variable store, the tokenizer, command dispatch, control statements
+ * (while condition, for step), whole scripts run by exec (per instruction, launch and page-ins included) and ready
+ * queue enqueue/dequeue for every scheduling policy.
+ *
+ * Usage: bench/microbench [-c] [RUNS]
+ *   -c    prints CSV (benchmark,mean_ns,stddev_ns,median_ns,min_ns,runs) instead of the table, used by perfcheck.sh
+ * Built and run with: make bench (linked against the objects of make mysh, built with the same settings)
+ *
+ * Every benchmark is calibrated to run for at least TARGET_RUN_NS, then timed RUNS times (default 10). The table
+ * reports the mean ns/op over the runs, the standard deviation between runs, the median and fastest runs and the
+ * coefficient of variation: a change is only meaningful when it is larger than the spread.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "../shellmemory.h"
+#include "../pcb.h"
+#include "../backing_store.h"
+#include "../interpreter.h"
+#include "../scheduler.h"
+#include "../policy.h"
+#include "../tokenizer.h"
+#include "../output.h"
+#include "../clock.h"
+
+// Variables defined in makefile
+// FRAMESIZE, NFRAMES
+
+#define DEFAULT_RUNS 10
+#define TARGET_RUN_NS 5000000LL  // Minimum length of a timed run (iterations are doubled until a run is this long)
+#define SCRIPT_PAGES (NFRAMES + 2) // Pages of the benchmark script, more than fit in the frame store
+#define QUEUE_DEPTH 64           // Processes kept in the ready queue by the scheduler benchmarks
+#define EXEC_SCRIPT_LINES 1024   // Lines of the script run by the exec benchmark (power of 2, like the iterations)
+
+struct benchmark
+{
+    const char *name;
+    void (*run)(long long iters);
+};
+
+struct bench_state // Fixtures shared by the benchmarks (built by setup)
+{
+    char script[32];                     // Benchmark script (SCRIPT_PAGES pages of "set" lines)
+    char exec_script[32];                // Script of the exec benchmark (EXEC_SCRIPT_LINES set and echo lines)
+    struct pcb *proc;                    // Materialized process of script
+    struct pcb *queued[QUEUE_DEPTH];     // Process stubs cycled through the ready queue
+    struct parsed_line *line;            // Pre-tokenized "set" line
+    struct parsed_line *cond_line;       // Pre-tokenized while statement
+    struct parsed_line *for_line;        // Pre-tokenized for statement
+    struct flow_entry flow;              // Control flow of the statement run by ctl
+    struct pcb ctl;                      // Process running the control statements (only its pc and flow are used)
+    const struct sched_policy *policy;   // Policy of the scheduler benchmark being run
+} b;
+
+char *set_words[] = {"set", "bench_var", "1"};
+const char *input_line = "set greeting hello world; echo $greeting\n";
+volatile long long sink; // Keeps results alive so the measured calls are not optimized away
+int csv = 0;             // Indicator (1 if results are printed as CSV)
+
+void bench_read_hit(long long iters)
+{
+    b.proc->pc = 0; // First page is resident
+    for (long long i = 0; i < iters; i++)
+        release_line(read_instruction(b.proc));
+}
+
+void bench_read_miss(long long iters)
+{
+    b.proc->pc = (SCRIPT_PAGES - 1) * FRAMESIZE; // Last page is never loaded by materialize_process
+    for (long long i = 0; i < iters; i++)
+        sink += read_instruction(b.proc) == NULL;
+}
+
+void bench_load_page(long long iters)
+{
+    // Cycle through more pages than there are frames, so every load also evicts a page
+    for (long long i = 0; i < iters; i++)
+        sink += load_from_backing_store(b.proc, (int)(i % SCRIPT_PAGES) * FRAMESIZE);
+}
+
+void bench_mem_set(long long iters)
+{
+    for (long long i = 0; i < iters; i++)
+        mem_set_value("bench_var", "value");
+}
+
+void bench_mem_get(long long iters)
+{
+    for (long long i = 0; i < iters; i++)
+    {
+        char *value = mem_get_value("bench_var");
+        sink += value != NULL;
+        free(value);
+    }
+}
+
+void bench_tokenize(long long iters)
+{
+    struct token_list tokens;
+    char buffer[128];
+    size_t len = strlen(input_line) + 1;
+
+    init_tokens(&tokens);
+    for (long long i = 0; i < iters; i++)
+    {
+        int pos = 0;
+        memcpy(buffer, input_line, len); // Words are terminated in place, every iteration needs a fresh line
+        while (next_command(buffer, &pos, &tokens) != -1)
+            sink += tokens.n;
+    }
+    free_tokens(&tokens);
+}
+
+void bench_interpreter(long long iters)
+{
+    for (long long i = 0; i < iters; i++)
+        sink += interpreter(set_words, 3);
+}
+
+void bench_parsed(long long iters)
+{
+    for (long long i = 0; i < iters; i++)
+        sink += run_parsed_command(b.line, &b.line->cmds[0]);
+}
+
+void bench_while(long long iters)
+{
+    b.flow = (struct flow_entry){.kind = FLOW_WHILE, .target = 1};
+    for (long long i = 0; i < iters; i++)
+        sink += run_control_line(&b.ctl, b.cond_line);
+}
+
+void bench_for(long long iters)
+{
+    b.flow = (struct flow_entry){.kind = FLOW_FOR, .target = 1};
+    for (long long i = 0; i < iters; i++)
+        sink += run_control_line(&b.ctl, b.for_line); // Sets bench_i to the next item (the range never ends)
+}
+
+void bench_exec(long long iters)
+{
+    char *exec_words[] = {"exec", b.exec_script, "FCFS"};
+
+    // One op is one instruction: the script is launched, copied into the backing store and run to completion
+    out_mute(1); // Output of the echo lines
+    for (long long i = 0; i < iters; i += EXEC_SCRIPT_LINES)
+    {
+        sink += interpreter(exec_words, 3);
+        run_scheduler_until_done(-1);
+    }
+    out_mute(0);
+}
+
+void bench_scheduler(long long iters)
+{
+    // Steady state: the queue holds QUEUE_DEPTH processes, every op dequeues the head and enqueues it again
+    for (long long i = 0; i < iters; i++)
+    {
+        pop_front();
+        b.policy->enqueue(current_process());
+    }
+}
+
+struct benchmark benchmarks[] = {
+    {"read_instruction.hit", bench_read_hit},
+    {"read_instruction.miss", bench_read_miss},
+    {"load_from_backing_store", bench_load_page},
+    {"mem_set_value", bench_mem_set},
+    {"mem_get_value", bench_mem_get},
+    {"next_command", bench_tokenize},
+    {"interpreter.set", bench_interpreter},
+    {"run_parsed_command.set", bench_parsed},
+    {"run_control_line.while", bench_while},
+    {"run_control_line.for", bench_for},
+    {"exec.set_echo", bench_exec}, // Last: resets the frames (b.proc's pages) once its processes are done
+};
+
+#define N_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/*
+ * Creates the fixtures: the shell's state (as main does), a materialized process and a pre-tokenized line
+ */
+void setup()
+{
+    init_output();
+    init_memory();
+    init_scheduler();
+    init_backing_store();
+    if (init_commands() != 0)
+        exit(1);
+
+    strcpy(b.script, "/tmp/mysh_bench_XXXXXX");
+    int fd = mkstemp(b.script);
+    FILE *f = fd == -1 ? NULL : fdopen(fd, "w");
+    if (f == NULL)
+    {
+        perror("Unable to create benchmark script");
+        exit(1);
+    }
+    for (int i = 0; i < SCRIPT_PAGES * FRAMESIZE; i++)
+        fprintf(f, "set line%d %d\n", i, i);
+    fclose(f);
+
+    strcpy(b.exec_script, "/tmp/mysh_bench_XXXXXX");
+    fd = mkstemp(b.exec_script);
+    f = fd == -1 ? NULL : fdopen(fd, "w");
+    if (f == NULL)
+    {
+        perror("Unable to create benchmark script");
+        exit(1);
+    }
+    for (int i = 0; i < EXEC_SCRIPT_LINES / 2; i++)
+        fprintf(f, "set v%d %d\necho $v%d\n", i % 8, i, i % 8);
+    fclose(f);
+
+    b.proc = load_script(b.script);
+    if (b.proc == NULL || materialize_process(b.proc) != 0)
+    {
+        fprintf(stderr, "Unable to load benchmark script\n");
+        exit(1);
+    }
+
+    b.line = parse_line("set bench_var 1");
+    b.cond_line = parse_line("while $bench_var != $bench_i");
+    b.for_line = parse_line("for bench_i in 1..2000000000");
+    b.ctl.flow = &b.flow;
+    mem_set_value("bench_var", "value"); // First variable, the variable store benchmarks find it at once
+    for (int i = 0; i < 8; i++)          // Variables a script would also have, found before the loop variable
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "var%d", i);
+        mem_set_value(name, "0");
+    }
+    mem_set_value("bench_i", "1");
+}
+
+/*
+ * Fills the ready queue with process stubs of varied length for policy (as exec would)
+ */
+void setup_scheduler(const struct sched_policy *policy)
+{
+    while (rq_size() > 0)
+        pop_front();
+
+    b.policy = policy;
+    set_scheduler_policy(policy);
+    for (int i = 0; i < QUEUE_DEPTH; i++)
+    {
+        if (b.queued[i] == NULL)
+            b.queued[i] = load_script(b.script);
+        b.queued[i]->bound = 1 + (i * 37) % QUEUE_DEPTH; // Lengths in shuffled order
+        policy->enqueue(b.queued[i]);
+    }
+}
+
+/*
+ * Times iters iterations of run
+ *
+ * returns (long long): duration (ns)
+ */
+long long time_run(void (*run)(long long), long long iters)
+{
+    long long start = monotonic_ns();
+    run(iters);
+    return monotonic_ns() - start;
+}
+
+int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Calibrates, runs and reports one benchmark
+ */
+void measure(const char *name, void (*run)(long long), int runs)
+{
+    long long iters = 1;
+    while (time_run(run, iters) < TARGET_RUN_NS) // Also warms up caches and the variable store
+        iters *= 2;
+
+    double *samples = malloc(runs * sizeof(double)); // ns/op of each run
+    if (samples == NULL)
+        exit(1);
+
+    double sum = 0, sum_sq = 0;
+    for (int r = 0; r < runs; r++)
+    {
+        samples[r] = (double)time_run(run, iters) / iters;
+        sum += samples[r];
+        sum_sq += samples[r] * samples[r];
+    }
+    qsort(samples, runs, sizeof(double), compare_doubles);
+
+    double mean = sum / runs;
+    double var = runs > 1 ? (sum_sq - sum * mean) / (runs - 1) : 0;
+    double stddev = var > 0 ? sqrt(var) : 0;
+    double median = runs % 2 ? samples[runs / 2] : (samples[runs / 2 - 1] + samples[runs / 2]) / 2;
+    if (csv)
+        printf("%s,%.2f,%.2f,%.2f,%.2f,%d\n", name, mean, stddev, median, samples[0], runs);
+    else
+        printf("%-28s %10.1f %10.2f %10.1f %10.1f %7.1f%% %11lld\n", name, mean, stddev, median, samples[0],
+               100 * stddev / mean, iters);
+    fflush(stdout);
+    free(samples);
+}
+
+int main(int argc, char *argv[])
+{
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "-c") == 0)
+    {
+        csv = 1;
+        arg++;
+    }
+    int runs = arg < argc ? atoi(argv[arg]) : DEFAULT_RUNS;
+    if (runs < 1 || argc > arg + 1)
+    {
+        fprintf(stderr, "Usage: %s [-c] [RUNS]\n", argv[0]);
+        return 1;
+    }
+
+    setup();
+
+    if (csv)
+        printf("benchmark,mean_ns,stddev_ns,median_ns,min_ns,runs\n");
+    else
+    {
+        printf("frames=%d framesize=%d runs=%d\n", NFRAMES, FRAMESIZE, runs);
+        printf("%-28s %10s %10s %10s %10s %8s %11s\n", "benchmark", "ns/op", "stddev", "median", "min", "cv",
+               "iters/run");
+    }
+    for (int i = 0; i < N_BENCHMARKS; i++)
+        measure(benchmarks[i].name, benchmarks[i].run, runs);
+
+    for (int i = 0; sched_policies[i] != NULL; i++)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "rq_cycle.%s", sched_policies[i]->name);
+        setup_scheduler(sched_policies[i]);
+        measure(name, bench_scheduler, runs);
+    }
+
+    remove(b.script);
+    remove(b.exec_script);
+    clear_backing_store();
+    return 0;
+}
@@ -0,0 +1,152 @@
+#!/bin/bash
+# Performance regression gate: runs the microbenchmarks (bench/microbench) and a fixed workload, and compares the
+# results against two baselines:
+#   bench/perf_baseline.csv           committed, machine-independent metrics (page faults and evictions of the workload)
+#   _gate_build/perf_timings.csv      local (ignored by git), timings of this machine, tagged with its host name
+# Timings are only compared against a local baseline recorded on the same host: the gate refuses to run against one
+# from another host, and without one it only checks the committed metrics (timings are reported as unchecked).
+#
+# Usage: bench/perfcheck.sh [--update]      (make perfcheck / make perfbaseline build mysh and bench/microbench first)
+#   --update   records the results as the new baselines instead of comparing (commit bench/perf_baseline.csv if its
+#              metrics changed)
+#
+# A metric regresses when it is both slower than the baseline by more than PERF_MIN_CHANGE (default 0.15, i.e. 15%)
+# and significantly slower by Welch's t-test: t = (mean - base_mean) / sqrt(sd^2/n + base_sd^2/base_n) above
+# PERF_T (default 3). Noisy metrics therefore need a larger slowdown to fail, and deterministic ones (page faults and
+# evictions of the workload, whose deviation is 0) fail on any increase above PERF_MIN_CHANGE.
+#
+# Environment: PERF_RUNS (microbenchmark runs, default 15), PERF_WORKLOAD_RUNS (runs of each workload, default 7),
+# PERF_T, PERF_MIN_CHANGE
+#
+# Exits with 1 if a metric regressed.
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BASELINE="$ROOT/bench/perf_baseline.csv"
+LOCAL_BASELINE="$ROOT/_gate_build/perf_timings.csv"
+HOST=$(uname -n)
+COUNTS='^workload\.[^,]*\.(faults|evictions),' # Metrics that do not depend on the machine
+RUNS=${PERF_RUNS:-15}
+WORKLOAD_RUNS=${PERF_WORKLOAD_RUNS:-7}
+T_CRIT=${PERF_T:-3}
+MIN_CHANGE=${PERF_MIN_CHANGE:-0.15}
+POLICIES="FCFS SJF RR AGING"
+
+for binary in "$ROOT/mysh" "$ROOT/bench/microbench"; do
+	if [ ! -x "$binary" ]; then
+		echo "$binary not found, run make perfcheck" >&2
+		exit 1
+	fi
+done
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+RESULTS="$WORK/results.csv"
+
+# Microbenchmarks (metric,mean,stddev,n)
+echo "metric,mean,stddev,n" >"$RESULTS"
+(cd "$WORK" && "$ROOT/bench/microbench" -c "$RUNS") | awk -F, 'NR > 1 { print "micro." $1 "," $2 "," $3 "," $6 }' >>"$RESULTS"
+if [ "${PIPESTATUS[0]}" != 0 ]; then
+	echo "microbenchmarks failed" >&2
+	exit 1
+fi
+
+# Fixed workload: the mixed manifest of the default generated families, run under every policy
+SEED=1 "$ROOT/bench/gen_workload.sh" "$WORK/workload" 10 >/dev/null || exit 1
+for policy in $POLICIES; do
+	for ((r = 0; r < WORKLOAD_RUNS; r++)); do
+		start=$(date +%s%N)
+		stats=$(cd "$WORK/workload" && "$ROOT/mysh" -c "memstat reset; exec -f mix.manifest $policy; memstat json" | grep '^{"interval_s"')
+		end=$(date +%s%N)
+		echo "$policy $(((end - start) / 1000)) $stats"
+	done
+done | awk '
+function field(json, key,    v) {
+	if (!match(json, "\"" key "\":[0-9.]+"))
+		return 0
+	v = substr(json, RSTART, RLENGTH)
+	sub(/.*:/, "", v)
+	return v
+}
+{
+	p = $1
+	if (!(p in n)) order[n_policies++] = p
+	n[p]++
+	sum[p] += $2
+	sum_sq[p] += $2 * $2
+	faults[p] = field($3, "faults")
+	evictions[p] = field($3, "evictions")
+}
+END {
+	for (i = 0; i < n_policies; i++) {
+		p = order[i]
+		mean = sum[p] / n[p]
+		var = n[p] > 1 ? (sum_sq[p] - sum[p] * mean) / (n[p] - 1) : 0
+		printf "workload.%s.wall_us,%.1f,%.1f,%d\n", p, mean, (var > 0 ? sqrt(var) : 0), n[p]
+		printf "workload.%s.faults,%d,0,%d\n", p, faults[p], n[p]
+		printf "workload.%s.evictions,%d,0,%d\n", p, evictions[p], n[p]
+	}
+}' >>"$RESULTS"
+
+if [ "$1" == "--update" ]; then
+	mkdir -p "$(dirname "$LOCAL_BASELINE")"
+	{ head -n 1 "$RESULTS"; grep -E "$COUNTS" "$RESULTS"; } >"$BASELINE"
+	{ echo "# host=$HOST"; grep -v -E "$COUNTS" "$RESULTS"; } >"$LOCAL_BASELINE"
+	echo "Machine-independent baseline written to $BASELINE"
+	echo "Timing baseline of $HOST written to $LOCAL_BASELINE"
+	exit 0
+fi
+
+if [ ! -f "$BASELINE" ]; then
+	echo "No baseline ($BASELINE), record one with make perfbaseline" >&2
+	exit 1
+fi
+
+timings_checked=1
+if [ ! -f "$LOCAL_BASELINE" ]; then
+	echo "No timing baseline for this machine ($LOCAL_BASELINE): only page faults and evictions are checked," \
+		"record one with make perfbaseline before changing the code" >&2
+	timings_checked=0
+	: >"$WORK/timings.csv"
+else
+	base_host=$(sed -n 's/^# host=//p' "$LOCAL_BASELINE")
+	if [ "$base_host" != "$HOST" ]; then
+		echo "The timing baseline ($LOCAL_BASELINE) was recorded on ${base_host:-an unknown host}, not $HOST:" \
+			"timings are not comparable, record one with make perfbaseline" >&2
+		exit 1
+	fi
+	cp "$LOCAL_BASELINE" "$WORK/timings.csv"
+fi
+
+cat "$BASELINE" "$WORK/timings.csv" | awk -F, -v t_crit="$T_CRIT" -v min_change="$MIN_CHANGE" \
+	-v timings_checked="$timings_checked" '
+/^#/ || /^metric,/ { next } # Comments and headers
+NR == FNR { base_mean[$1] = $2; base_sd[$1] = $3; base_n[$1] = $4; next }
+{
+	name = $1; mean = $2; sd = $3; n = $4
+	if (!(name in base_mean)) {
+		printf "%-34s %12s %12.1f %9s %8s  %s\n", name, "-", mean, "-", "-", timings_checked ? "new" : "unchecked"
+		next
+	}
+	base = base_mean[name]
+	change = base > 0 ? mean / base - 1 : 0
+	se = sqrt(sd * sd / n + base_sd[name] * base_sd[name] / base_n[name])
+	if (se > 0)
+		t = sprintf("%.2f", (mean - base) / se)
+	else
+		t = mean > base ? "inf" : (mean < base ? "-inf" : "0")
+	significant = t == "inf" || (t != "-inf" && t + 0 > t_crit)
+	if (change > min_change && significant) {
+		status = "SLOWER"
+		failed++
+	} else
+		status = change < -min_change ? "faster" : "ok"
+	printf "%-34s %12.1f %12.1f %+8.1f%% %8s  %s\n", name, base, mean, 100 * change, t, status
+}
+BEGIN { printf "%-34s %12s %12s %9s %8s  %s\n", "metric", "baseline", "current", "change", "t", "status" }
+END {
+	if (failed) {
+		printf "perfcheck failed: %d metric(s) slower than the baseline beyond noise\n", failed
+		exit 1
+	}
+	print "perfcheck passed"
+}' - "$RESULTS"
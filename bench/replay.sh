@@ -0,0 +1,84 @@
+#!/bin/bash
+# Replay harness: runs the exec manifests of a workload (see gen_workload.sh) with mysh in batch mode, for every memory
+# geometry and scheduling policy, and collects paging and scheduling results into one CSV.
+#
+# Usage: bench/replay.sh WORKLOAD_DIR [OUT.csv]
+#
+# Environment:
+#   GEOMETRIES  memory geometries as FRAMESIZE:SINGLESIZE:VARMEMSIZE (default "18:3:10 30:3:10 12:2:10 60:6:20"),
+#               each one builds mysh from a copy of the sources (the tree's own build is left untouched)
+#   POLICIES    scheduling policies (default "FCFS SJF RR AGING")
+#   MANIFESTS   manifests of WORKLOAD_DIR to run (default: every *.manifest)
+#
+# One CSV row per (geometry, policy, manifest), written to OUT.csv (default: stdout):
+#   throughput is instructions per second of wall time, turnaround is the launch to exit time of processes (from
+#   "ps exits on"), faults/page_ins/evictions come from "memstat json".
+
+WORKLOAD=$1
+OUT=${2:-/dev/stdout}
+GEOMETRIES=${GEOMETRIES:-"18:3:10 30:3:10 12:2:10 60:6:20"}
+POLICIES=${POLICIES:-"FCFS SJF RR AGING"}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+
+if [ ! -d "$WORKLOAD" ]; then
+	echo "Usage: $0 WORKLOAD_DIR [OUT.csv]" >&2
+	exit 1
+fi
+WORKLOAD=$(cd "$WORKLOAD" && pwd)
+if [ -z "$MANIFESTS" ]; then
+	MANIFESTS=$(cd "$WORKLOAD" && ls *.manifest)
+fi
+
+BUILD=$(mktemp -d)
+trap 'rm -rf "$BUILD"' EXIT
+cp "$ROOT"/*.c "$ROOT"/*.h "$ROOT"/Makefile "$BUILD" || exit 1
+
+echo "framesize,singlesize,varmemsize,policy,manifest,processes,instructions,wall_s,throughput_ips,faults,page_ins,evictions,hit_rate,turnaround_mean_ms,turnaround_max_ms,wait_mean_ms" >"$OUT"
+
+for geometry in $GEOMETRIES; do
+	IFS=: read -r framesize singlesize varmemsize <<<"$geometry"
+	mysh="$BUILD/mysh_${framesize}_${singlesize}_${varmemsize}"
+	if ! make -s -B -C "$BUILD" mysh framesize="$framesize" singlesize="$singlesize" varmemsize="$varmemsize" >/dev/null; then
+		echo "build failed for geometry $geometry" >&2
+		exit 1
+	fi
+	mv "$BUILD/mysh" "$mysh"
+
+	for policy in $POLICIES; do
+		for manifest in $MANIFESTS; do
+			start=$(date +%s%N)
+			output=$(cd "$WORKLOAD" && "$mysh" -c "ps exits on; memstat reset; exec -f $manifest $policy; memstat json")
+			end=$(date +%s%N)
+
+			echo "$output" | awk -v prefix="$framesize,$singlesize,$varmemsize,$policy,${manifest%.manifest}" \
+				-v wall_ns=$((end - start)) '
+			function field(json, key,    v) {
+				if (!match(json, "\"" key "\":[0-9.]+"))
+					return 0
+				v = substr(json, RSTART, RLENGTH)
+				sub(/.*:/, "", v)
+				return v
+			}
+			/^Process [0-9]+ \(.*\) exited: / {
+				s = $0
+				sub(/.* exited: /, "", s)
+				split(s, parts, ", ") # instructions, slices, faults, wait, run, resident, turnaround
+				split(parts[4], wait, " ")
+				split(parts[7], turnaround, " ")
+				procs++
+				wait_sum += wait[2]
+				turnaround_sum += turnaround[2]
+				if (turnaround[2] > turnaround_max)
+					turnaround_max = turnaround[2]
+			}
+			/^\{"interval_s"/ { stats = $0 }
+			END {
+				wall = wall_ns / 1e9
+				hits = field(stats, "hits")
+				printf "%s,%d,%d,%.6f,%.0f,%d,%d,%d,%.4f,%.3f,%.3f,%.3f\n", prefix, procs, hits, wall, hits / wall,
+					field(stats, "faults"), field(stats, "page_ins"), field(stats, "evictions"), field(stats, "hit_rate"),
+					procs ? turnaround_sum / procs : 0, turnaround_max, procs ? wait_sum / procs : 0
+			}' >>"$OUT"
+		done
+	done
+done
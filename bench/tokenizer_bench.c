@@ -0,0 +1,148 @@
+/*
+ * Tokenizer microbenchmark: lines/second of next_command (tokenizer.c) against the previous readInput, which copied
+ * every word into a stack buffer and strdup'd it (the caller then freed every word after running the command).
+ *
+ * Usage: bench/tokenizer_bench [iterations]
+ * Built with: make tokenizer_bench
+ *
+ * Both tokenizers are given a fresh copy of each line per iteration, since next_command terminates words in place
+ * (scheduled script lines are already private copies, see read_instruction).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../tokenizer.h"
+
+#define DEFAULT_ITERATIONS 2000000
+#define MAX_WORD_LEN 200 // Word limit of the previous readInput
+#define INIT_WORDS 100
+
+// Representative script lines
+const char *lines[] = {
+    "echo hello\n",
+    "set x 10\n",
+    "print x\n",
+    "set greeting hello world from the shell\n",
+    "echo $greeting; print x; echo done\n",
+    "run prog1.txt\n",
+    "exec prog1.txt prog2.txt prog3.txt RR\n",
+    "   echo   spaced\t  out   \n",
+};
+
+#define N_LINES (sizeof(lines) / sizeof(lines[0]))
+
+/*
+ * Previous readInput (shell.c), kept as the baseline
+ */
+int legacy_read_input(char ***words, int *words_cap, char *buffer, int *buff_pos)
+{
+    int w = 0;
+    char tmp[MAX_WORD_LEN];
+    char *tmpi = tmp;
+    char *end = tmp + MAX_WORD_LEN - 1;
+    char c;
+
+    if ((c = buffer[*buff_pos]) == '\0')
+        return -1;
+
+    while (c == ' ' || c == '\t')
+        c = buffer[++*buff_pos];
+
+    do
+    {
+        while (c != '\0' && c != ' ' && c != '\n' && c != ';' && tmpi < end)
+        {
+            *tmpi++ = c;
+            c = buffer[++*buff_pos];
+        }
+        *tmpi = '\0';
+
+        if (w == *words_cap)
+        {
+            char **grown = malloc(2 * *words_cap * sizeof(char *));
+            if (grown == NULL)
+                exit(1);
+            memcpy(grown, *words, w * sizeof(char *));
+            if (*words_cap > INIT_WORDS)
+                free(*words);
+            *words = grown;
+            *words_cap *= 2;
+        }
+
+        (*words)[w++] = strdup(tmp);
+        tmpi = tmp;
+
+        while (c == ' ' || c == '\t')
+            c = buffer[++*buff_pos];
+
+    } while (c != '\0' && c != '\n' && c != ';');
+
+    if (c != '\0')
+        ++*buff_pos;
+
+    return w;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    long iterations = argc > 1 ? atol(argv[1]) : DEFAULT_ITERATIONS;
+    char buffer[1000];
+    size_t lens[N_LINES];
+    long words_seen = 0; // Keeps the work observable so it can not be optimized away
+
+    for (size_t i = 0; i < N_LINES; i++)
+        lens[i] = strlen(lines[i]) + 1;
+
+    // Previous readInput
+    double start = now();
+    for (long it = 0; it < iterations; it++)
+    {
+        size_t l = it % N_LINES;
+        memcpy(buffer, lines[l], lens[l]);
+
+        char *words_init[INIT_WORDS];
+        char **words = words_init;
+        int words_cap = INIT_WORDS;
+        int pos = 0, w;
+        while ((w = legacy_read_input(&words, &words_cap, buffer, &pos)) != -1)
+        {
+            words_seen += w + words[0][0];
+            while (w--)
+                free(words[w]);
+        }
+        if (words != words_init)
+            free(words);
+    }
+    double legacy = now() - start;
+
+    // next_command
+    struct token_list tokens;
+    init_tokens(&tokens);
+    start = now();
+    for (long it = 0; it < iterations; it++)
+    {
+        size_t l = it % N_LINES;
+        memcpy(buffer, lines[l], lens[l]);
+
+        int pos = 0;
+        while (next_command(buffer, &pos, &tokens) != -1)
+            words_seen += tokens.n + tokens.words[0][0];
+    }
+    double sliced = now() - start;
+    free_tokens(&tokens);
+
+    printf("readInput     %12.0f lines/s\n", iterations / legacy);
+    printf("next_command  %12.0f lines/s\n", iterations / sliced);
+    printf("speedup       %12.2fx\n", legacy / sliced);
+
+    return words_seen == 0; // Never true
+}
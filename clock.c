@@ -0,0 +1,48 @@
+#include <time.h>
+
+#include "clock.h"
+
+int virtual_clock = 0;     // Indicator (1 while monotonic_ns reads the virtual clock, see simulate)
+long long virtual_now = 0; // Time of the virtual clock (ns)
+
+/*
+ * Function:  monotonic_ns
+ * --------------------
+ * returns (long long): current time of the monotonic clock in nanoseconds (for measuring durations), or of the
+ * virtual clock while it is on
+ */
+long long monotonic_ns()
+{
+    if (virtual_clock)
+        return virtual_now;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Function:  set_virtual_clock
+ * --------------------
+ * Switches monotonic_ns to a virtual clock starting at 1 ns (0 is used as "not measured" by callers), which only
+ * moves with advance_clock, or back to the real clock
+ *
+ * int on: 1 for the virtual clock, 0 for the real clock
+ */
+void set_virtual_clock(int on)
+{
+    virtual_clock = on;
+    virtual_now = 1;
+}
+
+/*
+ * Function:  advance_clock
+ * --------------------
+ * Moves the virtual clock forward
+ *
+ * long long ns: time to add (ns)
+ */
+void advance_clock(long long ns)
+{
+    virtual_now += ns;
+}
@@ -0,0 +1,8 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+long long monotonic_ns();
+void set_virtual_clock(int on);
+void advance_clock(long long ns);
+
+#endif
@@ -2,16 +2,37 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <errno.h>
 #include <dirent.h>
 #include <unistd.h>
 
 #include "shellmemory.h"
 #include "shell.h"
+#include "interpreter.h"
 #include "pcb.h"
 #include "scheduler.h"
 #include "backing_store.h"
+#include "jobs.h"
+#include "tokenizer.h"
+#include "output.h"
+#include "spawn.h"
+#include "trace.h"
+#include "ps.h"
+#include "stats.h"
+#include "timing.h"
+#include "simulate.h"
 
 #define ECHO_VAR_FLAG '$'
+#define EXEC_MANIFEST_FLAG "-f" // exec argument indicating the next argument is a manifest file
+#define BACKGROUND_FLAG "&"      // Final run/exec argument indicating the job should run in the background
+#define ARGS_UNBOUNDED -1       // max_args value of commands accepting any number of arguments
+#define MIN_COMMAND_TABLE_SIZE 16 // Initial number of slots of the command hash table (power of 2)
+#define SEEDS_PER_TABLE_SIZE 4096 // Number of hash seeds tried before the command hash table is grown
+#define SET_INLINE_LEN 1000 // Values set joins on the stack (longer values are joined on the heap)
+#define FOR_ITEMS_FLAG "in"  // Word between the variable and the items of a for loop
+#define RANGE_SEPARATOR ".." // for item A..B stands for every integer from A to B
+#define MAX_SOURCE_DEPTH 64   // Max number of nested source commands (a script sourcing itself would never end)
+#define TIME_COMMAND "time"   // Command timing the rest of its line, pipelines included (see is_pipeline)
 
 int help();
 int quit();
@@ -23,17 +44,214 @@ int echo(char *var);
 int badcommand();
 int set(char *args[], int n_args);
 int print(char *var);
-int run(char *script);
-int exec(char *args[], int n_args);
+int run(char *script, int job);
+int source(char *script);
+int has_control_statements(const char *text);
+int exec(char *args[], int n_args, int job);
+int jobs();
+int wait_jobs(char *job);
+int is_background(char *args[], int *n_args);
+int is_pipeline(char *args[], int n_args);
 int badcommandFileDoesNotExist();
 int badcommandTooManyTokens();
 int badcommandInvalidMode();
 int badcommandDuplicateScript();
 int badcommandFailedToLoadScript();
+int badcommandNoSuchJob();
+int badcommandWaitInScript();
+int badcommandControlOutsideScript();
+int badcommandSourceTooDeep();
+int badcommandBadCondition(const char *keyword);
+int badcommandBadFor();
+int eval_condition(char *args[], struct var_ref refs[], int n_args, int *truth);
+int next_for_item(char *args[], struct var_ref refs[], int n_args, int iter);
+char *word_value(char *word, struct var_ref *ref);
+int parse_integer(const char *s, long long *value);
+int parse_range(const char *word, long long *lo, long long *hi);
+int read_manifest(char *manifest, char ***scripts, int *n_scripts, int *cap);
+int add_script_name(char *name, char ***scripts, int *n_scripts, int *cap);
+
+struct command // Entry of the command registry
+{
+	const char *name;
+	int min_args; // Min number of arguments (not counting the command name)
+	int max_args; // Max number of arguments (ARGS_UNBOUNDED if there is no limit)
+	opcode_t op;  // Operation script lines running the command are compiled to (OP_CALL if none is specialized)
+	int (*handler)(char *args[], int n_args);		  // Handler of regular commands (args excludes the command name)
+	int (*launch)(char *args[], int n_args, int job); // Handler of commands launching processes (may end with '&')
+};
+
+int cmd_help(char *args[], int n_args);
+int cmd_quit(char *args[], int n_args);
+int cmd_set(char *args[], int n_args);
+int cmd_print(char *args[], int n_args);
+int cmd_echo(char *args[], int n_args);
+int cmd_ls(char *args[], int n_args);
+int cmd_resetmem(char *args[], int n_args);
+int cmd_jobs(char *args[], int n_args);
+int cmd_wait(char *args[], int n_args);
+int cmd_run(char *args[], int n_args, int job);
+int cmd_control(char *args[], int n_args);
+int cmd_source(char *args[], int n_args);
+
+// Command registry. New builtins only need an entry here (see init_commands)
+const struct command commands[] = {
+	{"help", 0, 0, OP_CALL, cmd_help, NULL},
+	{"quit", 0, 0, OP_CALL, cmd_quit, NULL},
+	{"set", 2, ARGS_UNBOUNDED, OP_SET, cmd_set, NULL},
+	{"print", 1, 1, OP_PRINT, cmd_print, NULL},
+	{"run", 1, 1, OP_CALL, NULL, cmd_run},
+	{"source", 1, 1, OP_CALL, cmd_source, NULL},
+	{"trace", 1, 2, OP_CALL, trace, NULL},
+	{"memstat", 0, 1, OP_CALL, memstat, NULL},
+	{"ps", 0, 2, OP_CALL, ps, NULL},
+	{"top", 0, 1, OP_CALL, top, NULL},
+	{"stats", 0, 3, OP_CALL, stats, NULL},
+	{TIME_COMMAND, 1, ARGS_UNBOUNDED, OP_CALL, time_command, NULL},
+	{"simulate", 1, 3, OP_CALL, simulate, NULL},
+	{"exec", 2, ARGS_UNBOUNDED, OP_CALL, NULL, exec},
+	{"echo", 1, 1, OP_ECHO, cmd_echo, NULL},
+	{"ls", 0, 0, OP_CALL, cmd_ls, NULL},
+	{"resetmem", 0, 0, OP_CALL, cmd_resetmem, NULL},
+	{"jobs", 0, 0, OP_CALL, cmd_jobs, NULL},
+	{"wait", 0, 1, OP_CALL, cmd_wait, NULL},
+	{"while", 0, ARGS_UNBOUNDED, OP_CALL, cmd_control, NULL}, // Control statements only run from scripts (see
+	{"for", 0, ARGS_UNBOUNDED, OP_CALL, cmd_control, NULL},   // run_control_line), elsewhere they are errors
+	{"if", 0, ARGS_UNBOUNDED, OP_CALL, cmd_control, NULL},
+	{"else", 0, ARGS_UNBOUNDED, OP_CALL, cmd_control, NULL},
+	{"fi", 0, ARGS_UNBOUNDED, OP_CALL, cmd_control, NULL},
+	{"done", 0, ARGS_UNBOUNDED, OP_CALL, cmd_control, NULL},
+};
+
+#define N_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+struct command_table // Perfect hash table of the command registry (built by init_commands)
+{
+	const struct command **slots; // Registry entry hashed to each slot (NULL if none)
+	unsigned int mask;			  // Number of slots - 1
+	unsigned int seed;			  // Hash seed for which no two commands collide
+} cmd_table;
+
+int first_command_stat = -1; // Stat id of the first command of the registry, the others follow in registry order
+
+unsigned int command_hash(const char *name, unsigned int seed);
+const struct command *find_command(const char *name);
+int command_stat(const struct command *cmd);
+int dispatch_parsed_command(struct parsed_line *line, struct parsed_command *pc);
+void error_parse_line_failed();
+void compile_command(struct parsed_line *parsed, struct parsed_command *pc);
+void *grow_line_array(void *array, void *inline_storage, int n, int cap, size_t size);
+char *join_words(char *words[], int n_words, char *inline_buf, size_t inline_size);
+int resolve_var(struct var_ref *ref);
+void assign_var(struct var_ref *ref, const char *value);
+void compile_control(struct parsed_line *parsed, struct parsed_command *pc);
+
+/*
+ * Function:  command_hash
+ * --------------------
+ * Seeded FNV-1a hash of a command name
+ */
+unsigned int command_hash(const char *name, unsigned int seed)
+{
+	unsigned int h = 2166136261u ^ seed;
+	for (const unsigned char *c = (const unsigned char *)name; *c != '\0'; ++c)
+	{
+		h ^= *c;
+		h *= 16777619u;
+	}
+	return h ^ (h >> 15);
+}
+
+/*
+ * Function:  init_commands
+ * --------------------
+ * Builds the command hash table. Searches for a hash seed that maps every command of the registry to its own slot,
+ * growing the table if no seed works, so that looking up a command takes one hash and one string compare.
+ *
+ * Also registers the latency histogram of every command (see stats_register).
+ *
+ * returns (int): status (0 on success, 1 if out of memory)
+ */
+int init_commands()
+{
+	unsigned int size = MIN_COMMAND_TABLE_SIZE;
+
+	first_command_stat = stats_register(commands[0].name);
+	for (unsigned int i = 1; i < N_COMMANDS && first_command_stat != -1; ++i)
+	{
+		if (stats_register(commands[i].name) == -1)
+			first_command_stat = -1; // Not every command fits, record none of them
+	}
+	while (size < 2 * N_COMMANDS)
+		size *= 2;
+
+	for (;; size *= 2)
+	{
+		const struct command **slots = calloc(size, sizeof(struct command *));
+		if (slots == NULL)
+			return 1;
+
+		for (unsigned int seed = 0; seed < SEEDS_PER_TABLE_SIZE; ++seed)
+		{
+			unsigned int i;
+			for (i = 0; i < N_COMMANDS; ++i)
+			{
+				unsigned int slot = command_hash(commands[i].name, seed) & (size - 1);
+				if (slots[slot] != NULL)
+					break; // Collision, try next seed
+				slots[slot] = &commands[i];
+			}
+
+			if (i == N_COMMANDS)
+			{
+				free(cmd_table.slots);
+				cmd_table.slots = slots;
+				cmd_table.mask = size - 1;
+				cmd_table.seed = seed;
+				return 0;
+			}
+			memset(slots, 0, size * sizeof(struct command *));
+		}
+		free(slots);
+	}
+}
+
+/*
+ * Function:  find_command
+ * --------------------
+ * Looks up a command in the registry
+ *
+ * returns (const struct command *): registry entry, NULL if there is no such command
+ */
+const struct command *find_command(const char *name)
+{
+	const struct command *cmd = cmd_table.slots[command_hash(name, cmd_table.seed) & cmd_table.mask];
+	if (cmd == NULL || strcmp(cmd->name, name) != 0)
+		return NULL;
+	return cmd;
+}
+
+/*
+ * Function:  command_stat
+ * --------------------
+ * Stat id of a command's latency histogram
+ *
+ * const struct command *cmd: registry entry, NULL for external programs
+ *
+ * returns (int): stat id, -1 if the command has no histogram
+ */
+int command_stat(const struct command *cmd)
+{
+	if (cmd == NULL)
+		return STAT_EXTERNAL;
+	return first_command_stat == -1 ? -1 : first_command_stat + (int)(cmd - commands);
+}
+
 /*
  * Function:  interpreter
  * --------------------
- * Checks command validity and then calls the corresponding command.
+ * Looks up the command and runs it (see run_command), recording its latency. Pipelines always run external programs
+ * (see run_external).
  *
  * char* command_args[]: arguments for the command to run
  * int args_size: number of arguments passed
@@ -47,71 +265,518 @@ int interpreter(char *command_args[], int args_size)
 		return badcommand();
 	}
 
-	if (strcmp(command_args[0], "help") == 0)
-	{
-		// help
-		if (args_size != 1)
-			return badcommand();
-		return help();
-	}
-	else if (strcmp(command_args[0], "quit") == 0)
+	long long start = STATS_START();
+	const struct command *cmd = is_pipeline(command_args, args_size) ? NULL : find_command(command_args[0]);
+	int status = run_command(cmd, command_args, args_size);
+	STATS_RECORD(command_stat(cmd), start);
+	return status;
+}
+
+/*
+ * Function:  run_command
+ * --------------------
+ * Checks the number of arguments against the registry and then calls the command's handler.
+ * Commands launching processes may end with '&' and are given the job their processes belong to.
+ *
+ * const struct command *cmd: registry entry of command_args[0] (see find_command), NULL to run an external program
+ * char* command_args[]: arguments for the command to run (not modified, so pre-tokenized lines can run repeatedly)
+ * int args_size: number of arguments passed
+ *
+ * returns (int): exit status
+ */
+int run_command(const struct command *cmd, char *command_args[], int args_size)
+{
+	int job, status, background = 0;
+
+	if (cmd == NULL)
+		return run_external(command_args, args_size, 0);
+
+	if (cmd->launch != NULL)
+		background = is_background(command_args, &args_size);
+
+	int n_args = args_size - 1;
+	if (n_args < cmd->min_args || (cmd->max_args != ARGS_UNBOUNDED && n_args > cmd->max_args))
+		return badcommand();
+
+	if (cmd->launch == NULL)
+		return cmd->handler(command_args + 1, n_args); // Pass in pointer to the first relevant arg
+
+	job = start_job(command_args, args_size, background);
+	status = cmd->launch(command_args + 1, n_args, job);
+	finish_job_launch(job);
+	return status;
+}
+
+/*
+ * Function:  parse_line
+ * --------------------
+ * Builds the pre-tokenized form of a script line: its commands, each with its words and registry entry, so that the
+ * line can be run (see run_parsed_line) without being parsed again. Words are slices of a private copy of the line,
+ * allocated in one block with the parsed line (short lines need no other allocation).
+ *
+ * const char *line: line of text (may contain several commands separated by ';')
+ *
+ * returns (struct parsed_line *): parsed line holding one reference (see release_line)
+ */
+struct parsed_line *parse_line(const char *line)
+{
+	size_t len = strlen(line);
+	struct parsed_line *parsed = malloc(sizeof(struct parsed_line) + len + 1);
+	if (parsed == NULL)
+		error_parse_line_failed();
+
+	parsed->refs = 1;
+	parsed->n_cmds = 0;
+	parsed->cmds = &parsed->inline_cmd;
+	parsed->words = parsed->inline_words;
+	parsed->text = memcpy(parsed->text_buf, line, len + 1);
+
+	// Words are terminated in place in the private copy, so only their pointers are collected
+	struct token_list tokens;
+	int pos = 0, n_words = 0, words_cap = LINE_INLINE_WORDS, cmds_cap = 1;
+	init_tokens(&tokens);
+	while (next_command(parsed->text, &pos, &tokens) != -1)
 	{
-		// quit
-		if (args_size != 1)
-			return badcommand();
-		return quit();
+		if (parsed->n_cmds == cmds_cap)
+		{
+			cmds_cap *= 2;
+			parsed->cmds = grow_line_array(parsed->cmds, &parsed->inline_cmd, parsed->n_cmds,
+										   cmds_cap, sizeof(struct parsed_command));
+		}
+		if (n_words + tokens.n > words_cap)
+		{
+			words_cap = 2 * (n_words + tokens.n);
+			parsed->words = grow_line_array(parsed->words, parsed->inline_words, n_words, words_cap, sizeof(char *));
+		}
+
+		memcpy(parsed->words + n_words, tokens.words, tokens.n * sizeof(char *));
+		parsed->cmds[parsed->n_cmds].cmd = find_command(tokens.words[0]);
+		parsed->cmds[parsed->n_cmds].first_word = n_words;
+		parsed->cmds[parsed->n_cmds].n_words = tokens.n;
+		parsed->n_cmds++;
+		n_words += tokens.n;
 	}
-	else if (strcmp(command_args[0], "set") == 0)
+
+	free_tokens(&tokens);
+
+	for (int i = 0; i < parsed->n_cmds; i++)
+		compile_command(parsed, &parsed->cmds[i]);
+
+	return parsed;
+}
+
+/*
+ * Function:  grow_line_array
+ * --------------------
+ * Grows an array of a parsed line, moving it out of the line's inline storage the first time it outgrows it
+ *
+ * void *array: array to grow
+ * void *inline_storage: inline storage of the array in the line
+ * int n: number of elements in use
+ * int cap: new capacity
+ * size_t size: size of an element
+ *
+ * returns (void *): grown array
+ */
+void *grow_line_array(void *array, void *inline_storage, int n, int cap, size_t size)
+{
+	void *grown = realloc(array == inline_storage ? NULL : array, cap * size);
+	if (grown == NULL)
+		error_parse_line_failed();
+	if (array == inline_storage)
+		memcpy(grown, array, n * size);
+	return grown;
+}
+
+/*
+ * Function:  compile_command
+ * --------------------
+ * Compiles a command of a parsed line to an operation. Builtins with a specialized opcode get their operands
+ * prepared once (set's value is joined, variable references are resolved on first use and cached) and arity errors
+ * are detected here. Everything else is compiled to OP_CALL and goes through run_command.
+ *
+ * struct parsed_line *parsed: line the command belongs to
+ * struct parsed_command *pc: command to compile
+ */
+void compile_command(struct parsed_line *parsed, struct parsed_command *pc)
+{
+	char **args = parsed->words + pc->first_word;
+	int n_args = pc->n_words - 1;
+
+	pc->op = OP_CALL;
+	pc->operand = NULL;
+	pc->owns_operand = 0;
+	pc->var.name = NULL;
+	pc->var.slot = -1;
+	pc->var.generation = 0;
+	pc->refs = NULL;
+
+	if (pc->cmd == NULL || is_pipeline(args, pc->n_words))
 	{
-		// set
-		if (args_size < 3)
-			return badcommand();
-		return set(command_args + 1, args_size - 1); // Pass in pointer to the first relevant arg
+		pc->op = OP_EXTERNAL;
+		return;
 	}
-	else if (strcmp(command_args[0], "print") == 0)
+
+	if (pc->cmd->handler == cmd_control)
 	{
-		// print
-		if (args_size != 2)
-			return badcommand();
-		return print(command_args[1]);
+		compile_control(parsed, pc);
+		return;
 	}
-	else if (strcmp(command_args[0], "run") == 0)
+
+	// Commands launching processes may end with '&', run_command checks their arity
+	if (pc->cmd->launch == NULL &&
+		(n_args < pc->cmd->min_args || (pc->cmd->max_args != ARGS_UNBOUNDED && n_args > pc->cmd->max_args)))
 	{
-		// run
-		if (args_size != 2)
-			return badcommand();
-		return run(command_args[1]);
+		pc->op = OP_BAD;
+		return;
 	}
-	else if (strcmp(command_args[0], "exec") == 0)
+
+	switch (pc->cmd->op)
 	{
-		// exec
-		if (args_size < 3 || args_size > 5)
-			return badcommand();
-		return exec(command_args + 1, args_size - 1);
+	case OP_ECHO:
+		if (args[1][0] == ECHO_VAR_FLAG)
+		{
+			pc->op = OP_ECHO_VAR;
+			pc->var.name = args[1] + 1;
+		}
+		else
+		{
+			pc->op = OP_ECHO;
+			pc->operand = args[1];
+		}
+		break;
+	case OP_PRINT:
+		pc->op = OP_PRINT;
+		pc->var.name = args[1];
+		break;
+	case OP_SET:
+		if (n_args > 6)
+			break; // Left to set to report the error
+		pc->op = OP_SET;
+		pc->var.name = args[1];
+		if (n_args == 2)
+		{
+			pc->operand = args[2];
+		}
+		else
+		{
+			pc->operand = join_words(args + 2, n_args - 1, NULL, 0);
+			pc->owns_operand = 1;
+		}
+		break;
+	default:
+		break;
 	}
-	else if (strcmp(command_args[0], "echo") == 0)
+}
+
+/*
+ * Function:  compile_control
+ * --------------------
+ * Prepares the variable operands of a while/if condition or a for statement (see run_control_line): '$' words and
+ * the for variable get a var_ref, so the variable store is only searched again once it is cleared.
+ *
+ * struct parsed_line *parsed: line the statement belongs to
+ * struct parsed_command *pc: statement (its keyword is the first word)
+ */
+void compile_control(struct parsed_line *parsed, struct parsed_command *pc)
+{
+	char **args = parsed->words + pc->first_word + 1; // Skip the keyword
+	int n_args = pc->n_words - 1;
+	flow_kind_t kind = flow_keyword(parsed->words[pc->first_word], strlen(parsed->words[pc->first_word]));
+
+	if ((kind != FLOW_WHILE && kind != FLOW_IF && kind != FLOW_FOR) || n_args == 0)
+		return;
+
+	pc->refs = calloc(n_args, sizeof(struct var_ref));
+	if (pc->refs == NULL)
+		error_parse_line_failed();
+
+	for (int i = 0; i < n_args; i++)
 	{
-		// echo
-		if (args_size != 2)
-			return badcommand();
-		return echo(command_args[1]);
+		pc->refs[i].slot = -1;
+		if (args[i][0] == ECHO_VAR_FLAG)
+			pc->refs[i].name = args[i] + 1;
 	}
-	else if (strcmp(command_args[0], "ls") == 0)
+	if (kind == FLOW_FOR)
+		pc->refs[0].name = args[0]; // The loop variable is named without '$'
+}
+
+/*
+ * Function:  join_words
+ * --------------------
+ * Joins words with single spaces (as set stores values with several words). Words may have any length.
+ *
+ * char *words[]: words to join
+ * int n_words: number of words
+ * char *inline_buf: buffer used if the result fits (may be NULL)
+ * size_t inline_size: size of inline_buf
+ *
+ * returns (char *): inline_buf if the result fits, otherwise a malloc'd string
+ */
+char *join_words(char *words[], int n_words, char *inline_buf, size_t inline_size)
+{
+	size_t len = 0;
+	for (int i = 0; i < n_words; i++)
+		len += strlen(words[i]) + 1;
+
+	char *joined = len <= inline_size ? inline_buf : malloc(len);
+	if (joined == NULL)
+		error_parse_line_failed();
+
+	char *end = joined;
+	for (int i = 0; i < n_words; i++)
 	{
-		// ls
-		if (args_size != 1)
-			return badcommand();
-		return ls();
+		if (i > 0)
+			*end++ = ' ';
+		size_t word_len = strlen(words[i]);
+		memcpy(end, words[i], word_len);
+		end += word_len;
 	}
-	else if (strcmp(command_args[0], "resetmem") == 0)
+	*end = '\0';
+
+	return joined;
+}
+
+/*
+ * Function:  resolve_var
+ * --------------------
+ * Returns the variable store slot of a variable operand, looking it up only if the cached slot is stale
+ *
+ * returns (int): slot of variable, -1 if the variable is not defined
+ */
+int resolve_var(struct var_ref *ref)
+{
+	if (ref->slot == -1 || ref->generation != mem_var_generation())
 	{
-		// resetmem
-		if (args_size != 1)
-			return badcommand();
-		return reset_mem();
+		ref->slot = mem_find_var(ref->name);
+		ref->generation = mem_var_generation();
 	}
+	return ref->slot;
+}
+
+/*
+ * Function:  assign_var
+ * --------------------
+ * Sets a variable operand, through its cached slot if the variable is defined
+ *
+ * struct var_ref *ref: variable to set
+ * const char *value: value (copied)
+ */
+void assign_var(struct var_ref *ref, const char *value)
+{
+	int slot = resolve_var(ref);
+	if (slot != -1)
+		mem_set_var_value(slot, value);
 	else
+		mem_set_value(ref->name, (char *)value);
+}
+
+/*
+ * Function:  run_parsed_command
+ * --------------------
+ * Runs a compiled command of a pre-tokenized line (see compile_command), recording its latency
+ *
+ * struct parsed_line *line: line the command belongs to
+ * struct parsed_command *pc: command to run
+ *
+ * returns (int): exit status
+ */
+int run_parsed_command(struct parsed_line *line, struct parsed_command *pc)
+{
+	long long start = STATS_START();
+	int status = dispatch_parsed_command(line, pc);
+	// Pipelines starting with a builtin's name run external programs, counted like at the prompt (see interpreter)
+	STATS_RECORD(pc->op == OP_BAD ? -1 : command_stat(pc->op == OP_EXTERNAL ? NULL : pc->cmd), start);
+	return status;
+}
+
+/*
+ * Function:  dispatch_parsed_command
+ * --------------------
+ * Runs the operation of a compiled command
+ *
+ * struct parsed_line *line: line the command belongs to
+ * struct parsed_command *pc: command to run
+ *
+ * returns (int): exit status
+ */
+int dispatch_parsed_command(struct parsed_line *line, struct parsed_command *pc)
+{
+	int slot;
+
+	switch (pc->op)
+	{
+	case OP_ECHO:
+		out_line(pc->operand);
+		return 0;
+	case OP_ECHO_VAR:
+		slot = resolve_var(&pc->var);
+		out_line(slot != -1 ? mem_var_value(slot) : ""); // Undefined variables print a blank line
+		return 0;
+	case OP_PRINT:
+		slot = resolve_var(&pc->var);
+		if (slot != -1)
+			out_line(mem_var_value(slot));
+		else
+			out_printf("Variable does not exist\n");
+		return 0;
+	case OP_SET:
+		assign_var(&pc->var, pc->operand);
+		return 0;
+	case OP_BAD:
 		return badcommand();
+	case OP_EXTERNAL:
+		return run_external(line->words + pc->first_word, pc->n_words, external_may_suspend());
+	default:
+		return run_command(pc->cmd, line->words + pc->first_word, pc->n_words);
+	}
+}
+
+/*
+ * Function:  error_parse_line_failed
+ * --------------------
+ * Out of memory while pre-tokenizing a script line. Like the tokenizer, the shell can not continue without it.
+ */
+void error_parse_line_failed()
+{
+	perror("Unable to allocate parsed line");
+	exit(1);
+}
+
+/*
+ * Function:  hold_line
+ * --------------------
+ * Takes a reference to a parsed line, keeping it alive while it runs even if its frame is evicted or reset
+ */
+void hold_line(struct parsed_line *parsed)
+{
+	parsed->refs++;
+}
+
+/*
+ * Function:  release_line
+ * --------------------
+ * Drops a reference to a parsed line, freeing it once no reference is left
+ */
+void release_line(struct parsed_line *parsed)
+{
+	if (parsed == NULL || --parsed->refs > 0)
+		return;
+
+	for (int i = 0; i < parsed->n_cmds; i++)
+	{
+		if (parsed->cmds[i].owns_operand)
+			free(parsed->cmds[i].operand);
+		free(parsed->cmds[i].refs);
+	}
+	if (parsed->cmds != &parsed->inline_cmd)
+		free(parsed->cmds);
+	if (parsed->words != parsed->inline_words)
+		free(parsed->words);
+	free(parsed);
+}
+// Registry handlers, unpack the arguments of each builtin
+
+int cmd_help(char *args[], int n_args)
+{
+	return help();
+}
+
+int cmd_quit(char *args[], int n_args)
+{
+	return quit();
+}
+
+int cmd_set(char *args[], int n_args)
+{
+	return set(args, n_args);
+}
+
+int cmd_print(char *args[], int n_args)
+{
+	return print(args[0]);
+}
+
+int cmd_run(char *args[], int n_args, int job)
+{
+	return run(args[0], job);
+}
+
+int cmd_echo(char *args[], int n_args)
+{
+	return echo(args[0]);
+}
+
+int cmd_ls(char *args[], int n_args)
+{
+	return ls();
+}
+
+int cmd_resetmem(char *args[], int n_args)
+{
+	return reset_mem();
+}
+
+int cmd_jobs(char *args[], int n_args)
+{
+	return jobs();
+}
+
+int cmd_wait(char *args[], int n_args)
+{
+	return wait_jobs(n_args == 1 ? args[0] : NULL);
+}
+
+int cmd_control(char *args[], int n_args)
+{
+	return badcommandControlOutsideScript();
+}
+
+int cmd_source(char *args[], int n_args)
+{
+	return source(args[0]);
+}
+
+/*
+ * Function:  is_background
+ * --------------------
+ * Checks if a run/exec command ends with '&', and removes the '&' from the arguments if it does
+ *
+ * char* args[]: command arguments
+ * int *n_args: number of arguments (decremented if the final '&' is removed)
+ *
+ * returns (int): 1 if the command should run in the background, 0 otherwise
+ */
+int is_background(char *args[], int *n_args)
+{
+	if (*n_args > 1 && strcmp(args[*n_args - 1], BACKGROUND_FLAG) == 0)
+	{
+		--*n_args;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Function:  is_pipeline
+ * --------------------
+ * Checks if a command is a pipeline (its words contain '|'). A pipeline after time is not: time runs it as a whole.
+ *
+ * char *args[]: words of the command
+ * int n_args: number of words
+ *
+ * returns (int): Indicator (1 if it is a pipeline, 0 otherwise)
+ */
+int is_pipeline(char *args[], int n_args)
+{
+	if (n_args > 0 && strcmp(args[0], TIME_COMMAND) == 0)
+		return 0;
+	for (int i = 0; i < n_args; i++)
+	{
+		if (is_pipe(args[i]))
+			return 1;
+	}
+	return 0;
 }
 
 /*
@@ -130,11 +795,32 @@ quit					Exits / terminates the shell with “Bye!”\n \
 set VAR STRING				Assigns a value to shell memory\n \
 print VAR				Displays the STRING assigned to VAR\n \
 run SCRIPT.TXT				Executes the file SCRIPT.TXT\n \
-exec prog1 [prog2] [prog3] POLICY	Executes the entered scripts using the given policy\n \
+exec prog1 [prog2 ...] POLICY		Executes the entered scripts using the given policy\n \
+exec -f MANIFEST [...] POLICY		Executes every script listed (one per line) in MANIFEST\n \
+run/exec ... &				Runs the scripts in the background (prompt stays available)\n \
+source SCRIPT.TXT			Runs the commands of SCRIPT.TXT in place, without creating a process\n \
+jobs					Displays progress of background jobs\n \
+wait [JOB]				Waits for JOB (or all jobs) to finish\n \
+ps					Displays the accounting of running processes (instructions, slices, faults, times)\n \
+ps exits on|off				Prints a summary of each process when it exits\n \
+top [INTERVAL_MS]			Runs every process to completion, refreshing the ps table (busiest first)\n \
+memstat [json|reset]			Reports frame store and variable store statistics (json: one line JSON, reset: new interval)\n \
+trace on|off|clear			Starts/stops/clears recording of paging and scheduling events\n \
+trace dump FILE				Writes recorded events to FILE (CSV if it ends with .csv, Chrome trace JSON otherwise)\n \
+trace victims on|off			Prints the contents of evicted pages (off by default)\n \
+stats [on|off|reset]			Displays latency percentiles of each command (on/off: recording, off by default)\n \
+stats export FILE [INTERVAL_MS]		Writes latencies to FILE in the Prometheus text format periodically (off: stop)\n \
+time COMMAND [ARGS ...]			Runs COMMAND and reports real/user/sys time (run/exec: copy, page-in, exec, scheduler)\n \
+simulate MANIFEST [INSTR_NS [PAGEIN_NS]]	Compares every policy on the scripts of MANIFEST on a virtual clock\n \
 echo (STRING || $VAR)			Displays the STRING or the STRING associated with VAR\n \
 ls 					Lists all files and directories in the current directory\n \
-resetmem				Delete the contents of variable store\n";
-	printf("%s\n", help_string);
+resetmem				Delete the contents of variable store\n \
+while COND / done (in scripts)		Runs the lines in between while COND holds\n \
+for VAR in ITEMS / done (in scripts)	Runs the lines in between with VAR set to each item (A..B counts from A to B)\n \
+if COND / [else] / fi (in scripts)	Runs the lines in between if COND holds (COND: WORD or WORD OP WORD, OP: == != < <= > >=)\n \
+PROGRAM [ARGS ...]			Runs an external program (searched in PATH)\n \
+PROG1 [ARGS] | PROG2 [ARGS] ...		Runs external programs, each reading the output of the previous one\n";
+	out_printf("%s\n", help_string);
 	return 0;
 }
 
@@ -148,7 +834,7 @@ resetmem				Delete the contents of variable store\n";
 int quit()
 {
 	clear_backing_store();
-	printf("%s\n", "Bye!");
+	out_printf("%s\n", "Bye!");
 	exit(0);
 }
 
@@ -161,19 +847,97 @@ int quit()
  */
 int badcommand()
 {
-	printf("%s\n", "Unknown Command");
+	out_printf("%s\n", "Unknown Command");
 	return 1;
 }
 
 int badcommandFailedToLoadScript()
 {
-	printf("%s\n", "Failed to Load Script into Memory. Perhaps OOM?");
+	out_printf("%s\n", "Failed to Load Script into Memory. Perhaps OOM?");
 	return 8;
 }
 
+/*
+ * Function:  badcommandNoSuchJob
+ * --------------------
+ * Indicates that wait was given an unknown job id
+ *
+ * returns (int): status
+ */
+int badcommandNoSuchJob()
+{
+	out_printf("%s\n", "Bad command: No such job");
+	return 9;
+}
+
+/*
+ * Function:  badcommandWaitInScript
+ * --------------------
+ * Indicates that wait was used by a running script (only the prompt can wait for jobs)
+ *
+ * returns (int): status
+ */
+int badcommandWaitInScript()
+{
+	out_printf("%s\n", "Bad command: wait can only be used at the prompt");
+	return 10;
+}
+
+/*
+ * Function:  badcommandControlOutsideScript
+ * --------------------
+ * Indicates that a control statement was used outside of a script line of its own
+ *
+ * returns (int): status
+ */
+int badcommandControlOutsideScript()
+{
+	out_printf("%s\n", "Bad command: while/for/if/else/fi/done can only start a line of a script");
+	return 11;
+}
+
+/*
+ * Function:  badcommandSourceTooDeep
+ * --------------------
+ * Indicates that source commands were nested more than MAX_SOURCE_DEPTH deep (e.g. a script sourcing itself)
+ *
+ * returns (int): status
+ */
+int badcommandSourceTooDeep()
+{
+	out_printf("%s\n", "Bad command: source nested too deeply");
+	return 14;
+}
+
+/*
+ * Function:  badcommandBadCondition
+ * --------------------
+ * Indicates that the condition of a while/if is malformed (it is then false)
+ *
+ * returns (int): status
+ */
+int badcommandBadCondition(const char *keyword)
+{
+	out_printf("Bad command: Bad condition for %s (expected WORD or WORD OP WORD)\n", keyword);
+	return 12;
+}
+
+/*
+ * Function:  badcommandBadFor
+ * --------------------
+ * Indicates that a for loop is malformed (it then runs no iteration)
+ *
+ * returns (int): status
+ */
+int badcommandBadFor()
+{
+	out_printf("%s\n", "Bad command: Expected for VAR in ITEMS");
+	return 13;
+}
+
 int badcommandDuplicateScript()
 {
-	printf("Scripts must have unique names when called with exec");
+	out_printf("Scripts must have unique names when called with exec");
 	return 7;
 }
 /*
@@ -185,7 +949,7 @@ int badcommandDuplicateScript()
  */
 int badcommandFileDoesNotExist()
 {
-	printf("%s\n", "Bad command: File not found");
+	out_printf("%s\n", "Bad command: File not found");
 	return 3;
 }
 
@@ -198,7 +962,7 @@ int badcommandFileDoesNotExist()
  */
 int badcommandInvalidMode()
 {
-	printf("Bad command: Invalid Scheduler Mode\n");
+	out_printf("Bad command: Invalid Scheduler Mode\n");
 	return 4;
 }
 
@@ -211,7 +975,7 @@ int badcommandInvalidMode()
  */
 int badcommandTooManyTokens()
 {
-	printf("%s\n", "Bad command: Too many tokens");
+	out_printf("%s\n", "Bad command: Too many tokens");
 	return 5;
 }
 
@@ -224,7 +988,7 @@ int badcommandTooManyTokens()
  */
 int lsFailed()
 {
-	printf("%s\n", "An error occured while running ls");
+	out_printf("%s\n", "An error occured while running ls");
 	return 6;
 }
 
@@ -276,7 +1040,7 @@ int ls()
 
 	for (int i = 0; i < n; i++)
 	{
-		printf("%s\n", namelist[i]->d_name);
+		out_printf("%s\n", namelist[i]->d_name);
 		free(namelist[i]); // free mem
 	}
 	free(namelist);
@@ -304,17 +1068,14 @@ int set(char *args[], int n_args)
 
 	char *var = args[0];
 
-	char *sep = " "; // separate multiple tokens with a space
-	char buffer[1000];
-	strcpy(buffer, args[1]);
+	// separate multiple tokens with a space (long values move to the heap)
+	char buffer[SET_INLINE_LEN];
+	char *value = join_words(args + 1, n_args - 1, buffer, sizeof(buffer));
 
-	for (int i = 2; i < n_args; ++i)
-	{
-		strcat(buffer, sep);
-		strcat(buffer, args[i]);
-	}
+	mem_set_value(var, value);
 
-	mem_set_value(var, buffer);
+	if (value != buffer)
+		free(value);
 
 	return 0;
 }
@@ -336,17 +1097,17 @@ int echo(char *key)
 		char *val = mem_get_value(key + 1);
 		if (val != NULL)
 		{
-			printf("%s\n", val);
+			out_line(val);
 			free(val); // mem_get_value creates a copy which goes out of scope here
 		}
 		else
 		{
-			printf("\n");
+			out_line("");
 		}
 	}
 	else
 	{
-		printf("%s\n", key);
+		out_line(key);
 	}
 	return 0;
 }
@@ -367,12 +1128,12 @@ int print(char *key)
 	char *val = mem_get_value(key);
 	if (val != NULL)
 	{
-		printf("%s\n", val);
+		out_line(val);
 		free(val);
 	}
 	else
 	{
-		printf("Variable does not exist\n");
+		out_printf("Variable does not exist\n");
 	}
 
 	return 0;
@@ -391,10 +1152,11 @@ int reset_mem()
  * Opens file and loads script into memory
  *
  * char* script: filename to open. An error is thrown if the file is not found.
+ * int job: job the new process belongs to
  *
  * returns (int): status
  */
-int run(char *script)
+int run(char *script, int job)
 {
 
 	// Check if file exists and can be read from
@@ -409,71 +1171,473 @@ int run(char *script)
 		return badcommandFailedToLoadScript();
 	}
 
-	set_scheduler_mode(FCFS);
+	set_scheduler_policy(find_policy("FCFS"));
+	p->job = job;
 	add_process(p);
 
 	return 0;
 }
 
+/*
+ * Function:  source
+ * --------------------
+ * Runs the commands of a script in place, as if they were part of the command running source (typed at the prompt,
+ * or an instruction of a running process). No process is created: the script is read in one go and run straight
+ * from that buffer, without a pcb, backing store copy, frames or a trip through the scheduler.
+ * Scripts with control statements need a process (see build_flow), they are run like run does.
+ *
+ * char* script: filename of script
+ *
+ * returns (int): status of the last command of the script
+ */
+int source(char *script)
+{
+	static int depth = 0; // Number of source commands being run
+
+	if (depth >= MAX_SOURCE_DEPTH)
+		return badcommandSourceTooDeep();
+
+	char *text = read_script(script);
+	if (text == NULL)
+		return badcommandFileDoesNotExist();
+
+	if (has_control_statements(text))
+	{
+		free(text);
+		char *run_args[] = {"run", script};
+		return run_command(find_command("run"), run_args, 2);
+	}
+
+	// At the prompt, processes launched by a command finish before the next one runs (like typed commands)
+	depth++;
+	int status = run_on_buffered_line(text, current_job() == -1);
+	depth--;
+
+	free(text);
+	return status;
+}
+
+/*
+ * Function:  has_control_statements
+ * --------------------
+ * Checks if a script has a line starting with a control statement keyword (see flow_keyword)
+ *
+ * const char *text: contents of script
+ *
+ * returns (int): Indicator (1 if it does, 0 otherwise)
+ */
+int has_control_statements(const char *text)
+{
+	const char *line = text;
+	while (*line != '\0')
+	{
+		while (*line == ' ' || *line == '\t')
+			line++;
+
+		int len = strcspn(line, " \n;|");
+		if (flow_keyword(line, len) != FLOW_NONE)
+			return 1;
+
+		line = strchr(line, '\n');
+		if (line == NULL)
+			break;
+		line++;
+	}
+	return 0;
+}
+
+/*
+ * Function:  jobs
+ * --------------------
+ * Prints progress of all jobs
+ *
+ * returns (int): status
+ */
+int jobs()
+{
+	print_jobs();
+	return 0;
+}
+
+/*
+ * Function:  wait_jobs
+ * --------------------
+ * Runs the scheduler until the given job (or every job) is done
+ *
+ * char* job: id of job to wait for, NULL to wait for all jobs
+ *
+ * returns (int): status
+ */
+int wait_jobs(char *job)
+{
+	if (current_job() != -1)
+		return badcommandWaitInScript(); // Would recursively start the scheduler
+
+	if (job == NULL)
+		return run_scheduler_until_done(-1);
+
+	int id = atoi(job);
+	if (!job_exists(id))
+		return badcommandNoSuchJob();
+
+	return run_scheduler_until_done(id);
+}
+
+/*
+ * Function:  add_script_name
+ * --------------------
+ * Appends a copy of a script name to a growable list of script names
+ *
+ * char *name: script name to add
+ * char ***scripts: list to append to (grown as needed)
+ * int *n_scripts: number of names in the list
+ * int *cap: allocated capacity of the list
+ *
+ * returns (int): status (0 on success, 1 if out of memory)
+ */
+int add_script_name(char *name, char ***scripts, int *n_scripts, int *cap)
+{
+	if (*n_scripts == *cap)
+	{
+		int new_cap = *cap == 0 ? 16 : *cap * 2;
+		char **grown = realloc(*scripts, new_cap * sizeof(char *));
+		if (grown == NULL)
+			return 1;
+		*scripts = grown;
+		*cap = new_cap;
+	}
+
+	(*scripts)[(*n_scripts)++] = strdup(name);
+	return 0;
+}
+
+/*
+ * Function:  read_manifest
+ * --------------------
+ * Reads an exec manifest: a file listing one script name per line.
+ * Leading/trailing whitespace is ignored, as are blank lines and lines starting with '#'.
+ *
+ * char *manifest: file name of the manifest
+ * char ***scripts, int *n_scripts, int *cap: list to append the script names to (see add_script_name)
+ *
+ * returns (int): status (0 on success, 1 if the manifest could not be read)
+ */
+int read_manifest(char *manifest, char ***scripts, int *n_scripts, int *cap)
+{
+	FILE *f = fopen(manifest, "rt");
+	if (f == NULL)
+		return 1;
+
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t n;
+	int status = 0;
+
+	while ((n = getline(&line, &line_size, f)) != -1)
+	{
+		char *name = line;
+		while (*name == ' ' || *name == '\t')
+			name++;
+
+		char *end = line + n;
+		while (end > name && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+			end--;
+		*end = '\0';
+
+		if (*name == '\0' || *name == '#')
+			continue;
+
+		if (add_script_name(name, scripts, n_scripts, cap) != 0)
+		{
+			status = 1;
+			break;
+		}
+	}
+
+	free(line);
+	fclose(f);
+	return status;
+}
+
 /*
  * Function:  exec
  * --------------------
  * Checks script name and mode validity
  * Loads all scripts into memory and sets scheduling mode as specified
  *
+ * Scripts can be given directly as arguments, or as "-f MANIFEST" where MANIFEST lists one script per line.
+ * Both forms can be mixed and there is no limit on the number of scripts.
+ * While processes of other jobs run, the policy can not change: exec then fails unless it names the running policy.
+ *
  * Note: exec does not trigger the scheduler to run (this is done in the main shell loop)
  *
+ * char* args[]: scripts and policy
+ * int n_args: number of arguments
+ * int job: job the new processes belong to
+ *
  * returns (int): status
  */
-int exec(char *args[], int n_args)
+int exec(char *args[], int n_args, int job)
 {
-	for (int i = 0; i < n_args - 1; ++i)
+	char **scripts = NULL;
+	int n_scripts = 0;
+	int cap = 0;
+	int status = 0;
+
+	// Collect scripts from arguments and manifests
+	for (int i = 0; i < n_args - 1 && status == 0; ++i)
 	{
-		if (access(args[i], R_OK) == -1)
-			return badcommandFileDoesNotExist();
+		if (strcmp(args[i], EXEC_MANIFEST_FLAG) == 0)
+		{
+			if (i + 1 >= n_args - 1)
+				status = badcommand(); // Missing manifest name
+			else if (read_manifest(args[++i], &scripts, &n_scripts, &cap) != 0)
+				status = badcommandFileDoesNotExist();
+		}
+		else if (add_script_name(args[i], &scripts, &n_scripts, &cap) != 0)
+		{
+			status = badcommandFailedToLoadScript();
+		}
+	}
 
-		// Allow Duplicate files in A3
-		// for (int j = i + 1; j < n_args - 1; ++j)
-		// {
-		// 	if (strcmp(args[i], args[j]) == 0)
-		// 	{
-		// 		return badcommandDuplicateScript();
-		// 	}
-		// }
+	if (status == 0 && n_scripts == 0)
+		status = badcommand(); // Empty manifest
+
+	// Allow Duplicate files in A3
+	for (int i = 0; i < n_scripts && status == 0; ++i)
+	{
+		if (access(scripts[i], R_OK) == -1)
+			status = badcommandFileDoesNotExist();
 	}
 
-	if (strcmp(args[n_args - 1], "FCFS") == 0)
+	if (status == 0)
 	{
-		set_scheduler_mode(FCFS);
+		const struct sched_policy *policy = find_policy(args[n_args - 1]);
+		if (policy == NULL)
+		{
+			status = badcommandInvalidMode();
+		}
+		else if (set_scheduler_policy(policy) != 0)
+		{
+			status = 1; // Processes of other jobs still run under another policy (error printed), enqueue nothing
+		}
 	}
-	else if (strcmp(args[n_args - 1], "SJF") == 0)
+
+	for (int i = 0; i < n_scripts && status == 0; ++i)
 	{
-		set_scheduler_mode(SJF);
+		struct pcb *p = load_script(scripts[i]);
+
+		if (p == NULL)
+		{
+			status = badcommandFailedToLoadScript();
+			break;
+		}
+
+		p->job = job;
+		add_process(p);
 	}
-	else if (strcmp(args[n_args - 1], "RR") == 0)
+
+	for (int i = 0; i < n_scripts; ++i)
+		free(scripts[i]);
+	free(scripts);
+
+	return status;
+}
+
+/*
+ * Function:  run_control_line
+ * --------------------
+ * Executes a control statement of a script (see build_flow): evaluates its condition, or moves its for loop to the
+ * next item, and picks the line to run next. Only the statement's own command is used, anything following it on
+ * the line (e.g. "; then" or "; do") is ignored.
+ *
+ * struct pcb *p: process running the statement (pc is the statement's line)
+ * struct parsed_line *line: the statement's line
+ *
+ * returns (int): line to run next
+ */
+int run_control_line(struct pcb *p, struct parsed_line *line)
+{
+	struct flow_entry *flow = &p->flow[p->pc];
+	char **args = line->words + line->cmds[0].first_word + 1; // Skip the keyword
+	struct var_ref *refs = line->cmds[0].refs;                // Compiled operands (see compile_control)
+	int n_args = line->cmds[0].n_words - 1;
+	int truth;
+
+	switch (flow->kind)
 	{
-		set_scheduler_mode(RR);
+	case FLOW_WHILE:
+	case FLOW_IF:
+		if (eval_condition(args, refs, n_args, &truth) != 0)
+			badcommandBadCondition(flow_keyword_name(flow->kind));
+		return truth ? p->pc + 1 : flow->target;
+	case FLOW_FOR:
+		if (next_for_item(args, refs, n_args, flow->iter))
+		{
+			flow->iter++;
+			return p->pc + 1;
+		}
+		flow->iter = 0; // Loop ends, it starts over if it is reached again
+		return flow->target;
+	case FLOW_ELSE:
+	case FLOW_DONE:
+		return flow->target;
+	default:
+		return p->pc + 1;
 	}
-	else if (strcmp(args[n_args - 1], "AGING") == 0)
+}
+
+/*
+ * Function:  eval_condition
+ * --------------------
+ * Evaluates the condition of a while/if. A condition is a single word (true unless empty or "0") or a comparison
+ * WORD OP WORD (OP is one of == != < <= > >=). Words starting with '$' stand for the value of a variable (undefined
+ * variables are empty). Integers are compared by value, other words alphabetically.
+ *
+ * char *args[]: words of the condition
+ * struct var_ref refs[]: variables of the words (see compile_control), NULL to look them up by name
+ * int n_args: number of words
+ * int *truth: set to 1 if the condition holds, 0 otherwise
+ *
+ * returns (int): status (0 on success, 1 if the condition is malformed, it is then false)
+ */
+int eval_condition(char *args[], struct var_ref refs[], int n_args, int *truth)
+{
+	*truth = 0;
+
+	if (n_args == 1)
 	{
-		set_scheduler_mode(AGING);
+		char *value = word_value(args[0], refs != NULL ? &refs[0] : NULL);
+		*truth = value[0] != '\0' && strcmp(value, "0") != 0;
+		return 0;
 	}
+
+	if (n_args != 3)
+		return 1;
+
+	char *lhs = word_value(args[0], refs != NULL ? &refs[0] : NULL);
+	char *op = args[1];
+	char *rhs = word_value(args[2], refs != NULL ? &refs[2] : NULL);
+	long long a, b;
+	int cmp;
+
+	if (parse_integer(lhs, &a) && parse_integer(rhs, &b))
+		cmp = (a > b) - (a < b);
+	else
+		cmp = strcmp(lhs, rhs);
+
+	if (strcmp(op, "==") == 0)
+		*truth = cmp == 0;
+	else if (strcmp(op, "!=") == 0)
+		*truth = cmp != 0;
+	else if (strcmp(op, "<") == 0)
+		*truth = cmp < 0;
+	else if (strcmp(op, "<=") == 0)
+		*truth = cmp <= 0;
+	else if (strcmp(op, ">") == 0)
+		*truth = cmp > 0;
+	else if (strcmp(op, ">=") == 0)
+		*truth = cmp >= 0;
 	else
+		return 1;
+
+	return 0;
+}
+
+/*
+ * Function:  next_for_item
+ * --------------------
+ * Sets the variable of a for loop to its next item. Items are words ('$' words stand for the value of a variable)
+ * and integer ranges A..B (every integer from A to B, counting down if B < A).
+ *
+ * char *args[]: words of the for statement after the keyword (VAR in ITEMS)
+ * struct var_ref refs[]: variables of the words (see compile_control), NULL to look them up by name
+ * int n_args: number of words
+ * int iter: index of the item
+ *
+ * returns (int): Indicator (1 if the variable was set, 0 if there are no items left)
+ */
+int next_for_item(char *args[], struct var_ref refs[], int n_args, int iter)
+{
+	char number[32];
+	long long lo, hi;
+	struct var_ref lookup = {.name = args[0], .slot = -1};
+	struct var_ref *var = refs != NULL ? &refs[0] : &lookup;
+
+	if (n_args < 2 || strcmp(args[1], FOR_ITEMS_FLAG) != 0)
 	{
-		return badcommandInvalidMode();
+		badcommandBadFor();
+		return 0;
 	}
 
-	for (int i = 0; i < n_args - 1; ++i)
+	for (int i = 2; i < n_args; i++)
 	{
-
-		struct pcb *p = load_script(args[i]);
-
-		if (p == NULL)
+		if (parse_range(args[i], &lo, &hi))
 		{
-			return badcommandFailedToLoadScript();
+			long long count = (hi >= lo ? hi - lo : lo - hi) + 1;
+			if (iter < count)
+			{
+				snprintf(number, sizeof(number), "%lld", hi >= lo ? lo + iter : lo - iter);
+				assign_var(var, number);
+				return 1;
+			}
+			iter -= count;
+		}
+		else if (iter-- == 0)
+		{
+			// May be the loop variable's own value, which set frees
+			char *value = strdup(word_value(args[i], refs != NULL ? &refs[i] : NULL));
+			if (value == NULL)
+				return 0;
+			assign_var(var, value);
+			free(value);
+			return 1;
 		}
-
-		add_process(p);
 	}
 	return 0;
-}
\ No newline at end of file
+}
+
+/*
+ * Function:  word_value
+ * --------------------
+ * char *word: word of a control statement
+ * struct var_ref *ref: its compiled variable (see compile_control), NULL to look the variable up by name
+ *
+ * returns (char *): value of a '$' word (empty if the variable is undefined), the word itself otherwise
+ */
+char *word_value(char *word, struct var_ref *ref)
+{
+	if (word[0] != ECHO_VAR_FLAG)
+		return word;
+
+	int slot = ref != NULL ? resolve_var(ref) : mem_find_var(word + 1);
+	return slot != -1 ? mem_var_value(slot) : "";
+}
+
+/*
+ * Function:  parse_integer
+ * --------------------
+ * returns (int): Indicator (1 if s is a whole decimal integer, stored in value, 0 otherwise)
+ */
+int parse_integer(const char *s, long long *value)
+{
+	char *end;
+	errno = 0;
+	*value = strtoll(s, &end, 10);
+	return end != s && *end == '\0' && errno == 0;
+}
+
+/*
+ * Function:  parse_range
+ * --------------------
+ * returns (int): Indicator (1 if word is an integer range A..B, stored in lo and hi, 0 otherwise)
+ */
+int parse_range(const char *word, long long *lo, long long *hi)
+{
+	char *end;
+	errno = 0;
+	*lo = strtoll(word, &end, 10);
+	if (end == word || errno != 0 || strncmp(end, RANGE_SEPARATOR, strlen(RANGE_SEPARATOR)) != 0)
+		return 0;
+	return parse_integer(end + strlen(RANGE_SEPARATOR), hi);
+}
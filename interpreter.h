@@ -1,7 +1,61 @@
 #ifndef INTERPRETER_H
 #define INTERPRETER_H
 
+struct command; // Entry of the command registry (interpreter.c)
+struct pcb;
+
+typedef enum // Operations script commands are compiled to (see compile_command)
+{
+	OP_CALL,     // Call the registry handler with the command's words
+	OP_BAD,      // Wrong number of arguments
+	OP_EXTERNAL, // Run external program or pipeline (see run_external)
+	OP_ECHO,     // Print operand
+	OP_ECHO_VAR, // Print value of var (blank line if undefined)
+	OP_PRINT,    // Print value of var
+	OP_SET       // Set var to operand
+} opcode_t;
+
+struct var_ref // Variable operand, its slot in the variable store is resolved once and cached
+{
+	char *name;
+	int slot;                // Cached slot (-1 if not resolved)
+	unsigned int generation; // Variable store generation the slot was found in (see mem_var_generation)
+};
+
+struct parsed_command // One command of a pre-tokenized line
+{
+	const struct command *cmd; // Registry entry (NULL if unknown command)
+	int first_word;            // Index of the command's first word in the line's words
+	int n_words;               // Number of words of the command
+	opcode_t op;               // Compiled operation
+	char *operand;             // String operand (echo text, set value)
+	int owns_operand;          // Indicator (1 if operand was allocated for this command, 0 if it is one of the words)
+	struct var_ref var;        // Variable operand (echo $VAR, print, set)
+	struct var_ref *refs;      // Variables of the words after the keyword of while/if/for (see compile_control), or NULL
+};
+
+#define LINE_INLINE_WORDS 4 // Words of a line stored in the line itself, longer lines allocate them
+
+struct parsed_line // Pre-tokenized script line (see parse_line), allocated in one block with its text
+{
+	int refs;                    // Number of references (frame holding the line, instructions running it)
+	int n_cmds;                  // Number of commands (separated by ';')
+	struct parsed_command *cmds; // Commands in order (inline_cmd for a single command)
+	char **words;                // Words of every command, slices of text (inline_words for short lines)
+	char *text;                  // Private copy of the line, words are NUL terminated in place
+	struct parsed_command inline_cmd;
+	char *inline_words[LINE_INLINE_WORDS];
+	char text_buf[];             // Storage of text
+};
+
+int init_commands();
 int interpreter(char* command_args[], int args_size);
+int run_command(const struct command *cmd, char *command_args[], int args_size);
+int run_parsed_command(struct parsed_line *line, struct parsed_command *cmd);
+int run_control_line(struct pcb *p, struct parsed_line *line);
+struct parsed_line *parse_line(const char *line);
+void hold_line(struct parsed_line *parsed);
+void release_line(struct parsed_line *parsed);
 int help();
 
-#endif
\ No newline at end of file
+#endif
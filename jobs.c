@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jobs.h"
+#include "scheduler.h"
+#include "output.h"
+
+#define MAX_LABEL_LEN 60 // Longest command label shown by jobs (longer commands are cut off with "...")
+
+struct job // A group of processes launched by a single run/exec command (plus everything they launch in turn)
+{
+    int id;
+    int background; // Indicator (1 if launched with '&', 0 if the prompt waits for the job)
+    int total;      // Number of processes launched by the job
+    int finished;   // Number of those processes that have terminated
+    char *label;    // Command that launched the job
+};
+
+struct jobs_state // State of the job table
+{
+    struct job *jobs; // Live jobs, ordered by id
+    int n;            // Number of live jobs
+    int cap;          // Allocated capacity of jobs
+    int next_id;      // Id assigned to the next job
+    int fg_running;   // Number of foreground jobs with unfinished processes
+} j_state = {NULL, 0, 0, 1, 0};
+
+struct job *find_job(int job);
+char *make_label(char *args[], int n_args, int background);
+
+/*
+ * Function:  find_job
+ * --------------------
+ * Looks up a live job by id
+ *
+ * int job: job id
+ *
+ * returns (struct job *): pointer to job (only valid until the job table changes), NULL if no such job
+ */
+struct job *find_job(int job)
+{
+    for (int i = 0; i < j_state.n; i++)
+    {
+        if (j_state.jobs[i].id == job)
+            return &j_state.jobs[i];
+    }
+    return NULL;
+}
+
+/*
+ * Function:  make_label
+ * --------------------
+ * Builds the label shown for a job from the words of the command that launched it
+ *
+ * returns (char *): malloc'd label
+ */
+char *make_label(char *args[], int n_args, int background)
+{
+    char *label = malloc(MAX_LABEL_LEN + 5);
+    if (label == NULL)
+        return NULL;
+
+    int len = 0;
+    for (int i = 0; i < n_args && len < MAX_LABEL_LEN; i++)
+    {
+        len += snprintf(label + len, MAX_LABEL_LEN + 1 - len, "%s%s", i ? " " : "", args[i]);
+    }
+
+    if (len > MAX_LABEL_LEN)
+        strcpy(label + MAX_LABEL_LEN - 3, "...");
+    else if (background)
+        strcpy(label + len, " &");
+
+    return label;
+}
+
+/*
+ * Function:  start_job
+ * --------------------
+ * Returns the job that processes launched by a run/exec command belong to.
+ * Commands executed by a running process extend that process's job, commands typed at the prompt start a new job.
+ *
+ * char *args[]: words of the launching command (used as the job's label)
+ * int n_args: number of words
+ * int background: Indicator (1 if the prompt should not wait for the new job)
+ *
+ * returns (int): job id
+ */
+int start_job(char *args[], int n_args, int background)
+{
+    int job = current_job();
+    if (job != -1)
+        return job;
+
+    if (j_state.n == j_state.cap)
+    {
+        int new_cap = j_state.cap == 0 ? 8 : j_state.cap * 2;
+        struct job *grown = realloc(j_state.jobs, new_cap * sizeof(struct job));
+        if (grown == NULL)
+            return -1;
+        j_state.jobs = grown;
+        j_state.cap = new_cap;
+    }
+
+    struct job *j = &j_state.jobs[j_state.n++];
+    j->id = j_state.next_id++;
+    j->background = background;
+    j->total = 0;
+    j->finished = 0;
+    j->label = make_label(args, n_args, background);
+
+    return j->id;
+}
+
+/*
+ * Function:  finish_job_launch
+ * --------------------
+ * Called once a run/exec command has added all its processes. Drops the job if no process could be launched.
+ *
+ * int job: job id
+ */
+void finish_job_launch(int job)
+{
+    struct job *j = find_job(job);
+    if (j != NULL && j->total == 0)
+        remove_job(job);
+}
+
+/*
+ * Function:  job_process_added
+ * --------------------
+ * Records that a process was added to the given job
+ *
+ * int job: job id
+ */
+void job_process_added(int job)
+{
+    struct job *j = find_job(job);
+    if (j == NULL)
+        return;
+
+    if (!j->background && j->total == j->finished)
+        j_state.fg_running++; // Foreground job (re)gained unfinished processes
+
+    j->total++;
+}
+
+/*
+ * Function:  job_process_finished
+ * --------------------
+ * Records that a process of the given job has terminated. Finished foreground jobs are forgotten immediately,
+ * finished background jobs are kept until reported (see print_jobs and report_finished_jobs).
+ *
+ * int job: job id
+ */
+void job_process_finished(int job)
+{
+    struct job *j = find_job(job);
+    if (j == NULL)
+        return;
+
+    j->finished++;
+
+    if (j->finished == j->total && !j->background)
+    {
+        j_state.fg_running--;
+        remove_job(job);
+    }
+}
+
+/*
+ * Function:  foreground_jobs_running
+ * --------------------
+ * Indicates if the prompt must wait for processes to finish
+ *
+ * returns (int): Indicator (1 if a foreground job has unfinished processes, 0 otherwise)
+ */
+int foreground_jobs_running()
+{
+    return j_state.fg_running > 0;
+}
+
+/*
+ * Function:  job_exists
+ * --------------------
+ * returns (int): Indicator (1 if a job with the given id is in the job table, 0 otherwise)
+ */
+int job_exists(int job)
+{
+    return find_job(job) != NULL;
+}
+
+/*
+ * Function:  job_done
+ * --------------------
+ * returns (int): Indicator (1 if all processes of the job have terminated or the job no longer exists, 0 otherwise)
+ */
+int job_done(int job)
+{
+    struct job *j = find_job(job);
+    return j == NULL || j->finished == j->total;
+}
+
+/*
+ * Function:  remove_job
+ * --------------------
+ * Removes a job from the job table
+ *
+ * int job: job id
+ */
+void remove_job(int job)
+{
+    struct job *j = find_job(job);
+    if (j == NULL)
+        return;
+
+    free(j->label);
+
+    int i = j - j_state.jobs;
+    memmove(j, j + 1, (j_state.n - i - 1) * sizeof(struct job));
+    j_state.n--;
+}
+
+/*
+ * Function:  print_jobs
+ * --------------------
+ * Prints progress of every job. Finished jobs are removed from the table once printed.
+ */
+void print_jobs()
+{
+    int i = 0;
+    while (i < j_state.n)
+    {
+        struct job *j = &j_state.jobs[i];
+        int done = j->finished == j->total;
+
+        out_printf("[%d] %-8s %d/%d processes finished\t%s\n", j->id, done ? "Done" : "Running", j->finished, j->total,
+               j->label ? j->label : "");
+
+        if (done)
+            remove_job(j->id);
+        else
+            i++;
+    }
+}
+
+/*
+ * Function:  report_finished_jobs
+ * --------------------
+ * Prints a notification for (and removes) every background job that finished since the last report.
+ * Called before the interactive prompt is printed.
+ */
+void report_finished_jobs()
+{
+    int i = 0;
+    while (i < j_state.n)
+    {
+        struct job *j = &j_state.jobs[i];
+        if (j->background && j->finished == j->total)
+        {
+            out_printf("[%d] Done\t%s\n", j->id, j->label ? j->label : "");
+            remove_job(j->id);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+int start_job(char *args[], int n_args, int background);
+void finish_job_launch(int job);
+void job_process_added(int job);
+void job_process_finished(int job);
+int foreground_jobs_running();
+int job_exists(int job);
+int job_done(int job);
+void remove_job(int job);
+void print_jobs();
+void report_finished_jobs();
+
+#endif
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "output.h"
+
+// Variables defined in makefile
+// OUTBUFSIZE
+
+struct output_state // Shell output buffer (everything the shell prints to stdout goes through it, keeping its order)
+{
+    char data[OUTBUFSIZE];
+    size_t len;         // Number of buffered bytes
+    int line_buffered;  // Indicator (1 if stdout is a terminal, output is then flushed at every newline)
+    int muted;          // Indicator (1 while output is discarded, see out_mute)
+} out;
+
+void write_all(struct iovec *iov, int n_iov);
+
+/*
+ * Function:  init_output
+ * --------------------
+ * Initializes the output buffer. Output is flushed when the buffer is full, when input is requested at the prompt,
+ * and when the shell exits (including through exit()). On a terminal output is also flushed at every newline.
+ */
+void init_output()
+{
+    out.len = 0;
+    out.muted = 0;
+    out.line_buffered = isatty(STDOUT_FILENO);
+    atexit(out_flush);
+}
+
+/*
+ * Function:  write_all
+ * --------------------
+ * Writes the given buffers to stdout with writev, resuming after partial writes
+ *
+ * struct iovec *iov: buffers to write (modified)
+ * int n_iov: number of buffers
+ */
+void write_all(struct iovec *iov, int n_iov)
+{
+    while (n_iov > 0)
+    {
+        ssize_t n = writev(STDOUT_FILENO, iov, n_iov);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return; // Output closed (e.g. broken pipe), drop it like stdio would
+        }
+
+        // Skip what was written
+        while (n_iov > 0 && (size_t)n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            n_iov--;
+        }
+        if (n_iov > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+/*
+ * Function:  out_flush
+ * --------------------
+ * Writes buffered output to stdout
+ */
+void out_flush()
+{
+    if (out.len == 0)
+        return;
+
+    struct iovec iov = {out.data, out.len};
+    write_all(&iov, 1);
+    out.len = 0;
+}
+
+/*
+ * Function:  out_write
+ * --------------------
+ * Appends data to the output buffer. Data that does not fit is written together with the buffered output in a
+ * single writev call (no copy).
+ *
+ * const char *data: data to print
+ * size_t len: number of bytes
+ */
+void out_write(const char *data, size_t len)
+{
+    if (out.muted)
+        return;
+    if (len <= OUTBUFSIZE - out.len)
+    {
+        memcpy(out.data + out.len, data, len);
+        out.len += len;
+        if (out.len == OUTBUFSIZE || (out.line_buffered && memchr(data, '\n', len) != NULL))
+            out_flush();
+        return;
+    }
+
+    struct iovec iov[2] = {{out.data, out.len}, {(void *)data, len}};
+    write_all(iov, 2);
+    out.len = 0;
+}
+
+/*
+ * Function:  out_puts
+ * --------------------
+ * Prints a string (no newline added)
+ */
+void out_puts(const char *s)
+{
+    out_write(s, strlen(s));
+}
+
+/*
+ * Function:  out_line
+ * --------------------
+ * Prints a string followed by a newline
+ */
+void out_line(const char *s)
+{
+    if (out.muted)
+        return;
+
+    size_t len = strlen(s);
+    if (len < OUTBUFSIZE - out.len) // Common case, the line fits, append it in one go
+    {
+        memcpy(out.data + out.len, s, len);
+        out.data[out.len + len] = '\n';
+        out.len += len + 1;
+        if (out.len == OUTBUFSIZE || out.line_buffered)
+            out_flush();
+        return;
+    }
+
+    out_write(s, len);
+    out_write("\n", 1);
+}
+
+/*
+ * Function:  out_printf
+ * --------------------
+ * printf into the output buffer
+ *
+ * returns (int): number of characters printed (negative on error)
+ */
+int out_printf(const char *format, ...)
+{
+    va_list args;
+    size_t space = OUTBUFSIZE - out.len;
+
+    if (out.muted)
+        return 0;
+
+    va_start(args, format);
+    int n = vsnprintf(out.data + out.len, space, format, args); // Usually formats straight into the buffer
+    va_end(args);
+
+    if (n < 0)
+        return n;
+
+    if ((size_t)n < space)
+    {
+        out.len += n;
+        if (out.line_buffered && memchr(out.data + out.len - n, '\n', n) != NULL)
+            out_flush();
+        return n;
+    }
+
+    // Did not fit (vsnprintf needs space for the terminating '\0' as well), format again on the heap
+    char *s = malloc(n + 1);
+    if (s == NULL)
+        return -1;
+
+    va_start(args, format);
+    vsnprintf(s, n + 1, format, args);
+    va_end(args);
+
+    out_write(s, n);
+    free(s);
+    return n;
+}
+
+/*
+ * Function:  out_mute
+ * --------------------
+ * Discards everything printed from now on (used while simulating processes), or prints again
+ *
+ * int on: 1 to discard output, 0 to print it
+ */
+void out_mute(int on)
+{
+    out.muted = on;
+}
@@ -0,0 +1,13 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+#include <stddef.h>
+
+void init_output();
+void out_write(const char *data, size_t len);
+void out_puts(const char *s);
+void out_line(const char *s);
+int out_printf(const char *format, ...);
+void out_flush();
+void out_mute(int on);
+
+#endif
@@ -1,17 +1,31 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "pcb.h"
 #include "shellmemory.h"
 #include "backing_store.h"
+#include "output.h"
+#include "trace.h"
+#include "clock.h"
+#include "stats.h"
+#include "replay.h"
+#include "timing.h"
+#include "simulate.h"
+#include "interpreter.h"
 
 p_t cur_pid = 0; // Simple method to ensure unique pid's for all processes. First process has pid 0, then 1, and so on...
 
+const char *flow_keywords[] = {NULL, "while", "for", "if", "else", "fi", "done"}; // Indexed by flow_kind_t
+
+void error_unmatched_flow(struct pcb *pcb, struct flow_mark *mark);
+
 /*
  * Function:  load_script
  * --------------------
  * Load script with given file name. Creates a new process with a new pcb.
- * Copies script into backing store and loads first two pages in frame memory.
+ * The pcb starts out as a lightweight stub that only knows the script's name and length (enough for the scheduler
+ * to order it). Nothing is copied into the backing store until the scheduler first picks it (see materialize_process).
  *
  *
  * char *file_name: filename of script to laod (must be a valid file in current dir)
@@ -20,42 +34,115 @@ p_t cur_pid = 0; // Simple method to ensure unique pid's for all processes. Firs
  */
 struct pcb *load_script(char *file_name)
 {
-    p_t pid = cur_pid++; // Assign process id
-
-    int n_lines = cp_to_store(file_name, pid); // Copy into backing store
+    int n_lines = count_script_lines(file_name);
 
-    if (n_lines <= 0) // Copy to backing store failed
+    if (n_lines <= 0) // Failed to read script
         return NULL;
 
     struct pcb *ret = malloc(sizeof(struct pcb));
     if (ret == NULL)
         return NULL;
 
-    ret->pid = pid;
+    ret->pid = cur_pid++; // Assign process id
     ret->bound = n_lines;
     ret->pc = 0;
+    ret->job = -1;
+    ret->materialized = 0;
+    ret->pagetable = NULL;
+    ret->page_offsets = NULL;
+    ret->flow = NULL;
+    ret->lines = NULL;
+    ret->owns_lines = 0;
+    memset(&ret->stats, 0, sizeof(ret->stats));
+    ret->stats.launched = monotonic_ns();
+    ret->stats.materialized = -1;
+    ret->stats.queued_at = ret->stats.launched; // Waits from launch until first dispatched
+    ret->script = strdup(file_name);
+
+    if (ret->script == NULL)
+    {
+        free(ret);
+        return NULL;
+    }
 
-    int n_pages = (n_lines + FRAMESIZE - 1) / FRAMESIZE;
+    return ret;
+}
+
+/*
+ * Function:  materialize_process
+ * --------------------
+ * Turns a process stub into a runnable process.
+ * Copies script into backing store (see copy_script, simulated processes take their script from the simulation
+ * instead, see simulate), creates the pagetable and loads first two pages in frame memory.
+ *
+ * struct pcb *pcb: pcb of process stub (see load_script)
+ *
+ * returns (int): status (0 on success, -1 on failure)
+ */
+int materialize_process(struct pcb *pcb)
+{
+    if ((simulating ? load_simulated_script(pcb) : copy_script(pcb)) != 0)
+        return -1;
+    pcb->stats.materialized = monotonic_ns();
+
+    int n_pages = (pcb->bound + FRAMESIZE - 1) / FRAMESIZE;
 
     // Instatiate pagetable
-    ret->pagetable = malloc(n_pages * sizeof(int));
+    pcb->pagetable = malloc(n_pages * sizeof(int));
 
-    if (ret->pagetable == NULL)
-        return NULL;
+    if (pcb->pagetable == NULL)
+        return -1;
 
     for (int i = 0; i < n_pages; ++i)
     {
-        ret->pagetable[i] = -1;
+        pcb->pagetable[i] = -1;
     }
 
-    load_page(ret, 0); // Load first page
+    load_page(pcb, 0); // Load first page
 
-    if (n_lines > FRAMESIZE) // Checks script is long enough to require two pages
+    if (pcb->bound > FRAMESIZE) // Checks script is long enough to require two pages
     {
-        load_page(ret, 1); // Load second page
+        load_page(pcb, 1); // Load second page
     }
 
-    return ret;
+    return 0;
+}
+
+/*
+ * Function:  copy_script
+ * --------------------
+ * Copies the script of a process into the backing store, compiling its lines (see cp_to_store) and its control
+ * statements (see build_flow)
+ *
+ * struct pcb *pcb: pcb of process stub (see load_script)
+ *
+ * returns (int): status (0 on success, -1 on failure)
+ */
+int copy_script(struct pcb *pcb)
+{
+    long *page_offsets;
+    struct flow_mark *marks;
+    struct parsed_line **lines;
+    int n_marks;
+    unsigned int checksum;
+    long long start = TIMING_START();
+    int n_lines = cp_to_store(pcb->script, pcb->pid, &page_offsets, &marks, &n_marks, &lines,
+                              log_mode != LOG_OFF ? &checksum : NULL); // Copy into backing store
+
+    if (n_lines <= 0) // Copy to backing store failed
+        return -1;
+    LOG_EVENT(LOG_SCRIPT, pcb->pid, checksum);
+
+    pcb->bound = n_lines; // Script may have changed since it was counted
+    pcb->page_offsets = page_offsets;
+    pcb->lines = lines;
+    pcb->owns_lines = 1;
+    pcb->materialized = 1;
+
+    int flow_ok = build_flow(pcb, marks, n_marks);
+    free(marks);
+    TIMING_END(PHASE_COPY, start);
+    return flow_ok ? 0 : -1;
 }
 
 /*
@@ -68,10 +155,19 @@ struct pcb *load_script(char *file_name)
  */
 void free_process(struct pcb *pcb)
 {
-    remove_process_store(pcb); // Remove script from backing store
+    if (pcb->page_offsets != NULL)
+        remove_process_store(pcb); // Remove script from backing store (simulated processes have none)
     // remove_process_claims(pcb);
 
+    for (int i = 0; pcb->owns_lines && i < pcb->bound; i++)
+        release_line(pcb->lines[i]); // Frames still holding a line keep their own reference
+    if (pcb->owns_lines)
+        free(pcb->lines);
+
     free(pcb->pagetable);
+    free(pcb->page_offsets);
+    free(pcb->flow);
+    free(pcb->script);
     free(pcb);
 }
 
@@ -86,7 +182,11 @@ void free_process(struct pcb *pcb)
  */
 void load_page(struct pcb *pcb, int page)
 {
+    SIM_CHARGE(page_in);
+    long long start = STATS_START(), timing_start = TIMING_START();
     int framenum = load_from_backing_store(pcb, page * FRAMESIZE);
+    STATS_RECORD(STAT_PAGE_IN, start);
+    TIMING_END(PHASE_PAGE_IN, timing_start);
 
     if (framenum == -1)
     {
@@ -94,4 +194,130 @@ void load_page(struct pcb *pcb, int page)
     }
 
     pcb->pagetable[page] = framenum; // Set frame number in pagetable
+    TRACE_EVENT(TRACE_PAGE_IN, pcb->pid, page);
+}
+
+/*
+ * Function:  flow_keyword
+ * --------------------
+ * Recognizes the keyword of a control statement
+ *
+ * const char *word: first word of a line (not necessarily NUL terminated)
+ * int len: length of word
+ *
+ * returns (flow_kind_t): kind of control statement, FLOW_NONE if word is not a keyword
+ */
+flow_kind_t flow_keyword(const char *word, int len)
+{
+    for (int kind = FLOW_WHILE; kind <= FLOW_DONE; kind++)
+    {
+        if ((int)strlen(flow_keywords[kind]) == len && strncmp(flow_keywords[kind], word, len) == 0)
+            return kind;
+    }
+    return FLOW_NONE;
+}
+
+/*
+ * Function:  flow_keyword_name
+ * --------------------
+ * returns (const char *): keyword of a kind of control statement (NULL for FLOW_NONE)
+ */
+const char *flow_keyword_name(flow_kind_t kind)
+{
+    return flow_keywords[kind];
+}
+
+/*
+ * Function:  build_flow
+ * --------------------
+ * Compiles the control statements of a script to jumps: matches every while/for with its done and every if with its
+ * else/fi, and records where each of them jumps (see struct flow_entry). Scripts without control statements get no
+ * flow table.
+ *
+ * struct pcb *pcb: process being materialized (bound must be set)
+ * struct flow_mark *marks: control statements of the script, in line order (see cp_to_store)
+ * int n_marks: number of control statements
+ *
+ * returns (int): Indicator (1 on success, 0 if a statement is unmatched or out of memory)
+ */
+int build_flow(struct pcb *pcb, struct flow_mark *marks, int n_marks)
+{
+    if (n_marks == 0)
+        return 1;
+
+    struct flow_entry *flow = calloc(pcb->bound, sizeof(struct flow_entry)); // Every line starts out as FLOW_NONE
+    struct flow_mark *open = malloc(n_marks * sizeof(struct flow_mark));     // Statements waiting for their end
+    int n_open = 0;
+
+    if (flow == NULL || open == NULL)
+    {
+        free(flow);
+        free(open);
+        return 0;
+    }
+
+    for (int i = 0; i < n_marks; i++)
+    {
+        struct flow_mark *m = &marks[i];
+        struct flow_mark *top = n_open > 0 ? &open[n_open - 1] : NULL;
+        flow[m->line].kind = m->kind;
+
+        switch (m->kind)
+        {
+        case FLOW_WHILE:
+        case FLOW_FOR:
+        case FLOW_IF:
+            open[n_open++] = *m;
+            continue;
+        case FLOW_ELSE:
+            if (top == NULL || top->kind != FLOW_IF)
+                break;
+            flow[top->line].target = m->line + 1; // if jumps past the else when COND fails
+            *top = *m;                            // else is now waiting for the fi
+            continue;
+        case FLOW_FI:
+            if (top == NULL || (top->kind != FLOW_IF && top->kind != FLOW_ELSE))
+                break;
+            flow[top->line].target = m->line + 1; // if/else jumps past the fi
+            n_open--;
+            continue;
+        case FLOW_DONE:
+            if (top == NULL || (top->kind != FLOW_WHILE && top->kind != FLOW_FOR))
+                break;
+            flow[m->line].target = top->line;     // done jumps back to the header
+            flow[top->line].target = m->line + 1; // header jumps past the done when the loop ends
+            n_open--;
+            continue;
+        default:
+            continue;
+        }
+
+        // Statement ending a construct that is not open
+        error_unmatched_flow(pcb, m);
+        free(flow);
+        free(open);
+        return 0;
+    }
+
+    if (n_open > 0)
+    {
+        error_unmatched_flow(pcb, &open[n_open - 1]);
+        free(flow);
+        free(open);
+        return 0;
+    }
+
+    free(open);
+    pcb->flow = flow;
+    return 1;
+}
+
+/*
+ * Function:  error_unmatched_flow
+ * --------------------
+ * Prints error for a control statement without its matching statement
+ */
+void error_unmatched_flow(struct pcb *pcb, struct flow_mark *mark)
+{
+    out_printf("Error: Unmatched %s on line %d of %s\n", flow_keywords[mark->kind], mark->line + 1, pcb->script);
 }
@@ -5,16 +5,68 @@
 
 typedef unsigned long long p_t;
 
+struct parsed_line; // Pre-tokenized script line (see interpreter.h)
+
+typedef enum // Control statements of scripts, recognized by the first word of a line (see flow_keyword)
+{
+    FLOW_NONE,  // Regular line
+    FLOW_WHILE, // while COND: runs the lines up to the matching done while COND holds
+    FLOW_FOR,   // for VAR in ITEMS: runs the lines up to the matching done once per item
+    FLOW_IF,    // if COND: runs the lines up to the matching else/fi if COND holds
+    FLOW_ELSE,  // else: runs the lines up to the matching fi if the if's COND did not hold
+    FLOW_FI,    // fi: ends an if
+    FLOW_DONE   // done: ends a while/for
+} flow_kind_t;
+
+struct flow_mark // Control statement found while copying a script into the backing store
+{
+    int line;
+    flow_kind_t kind;
+};
+
+struct flow_entry // Compiled control flow of a script line (see build_flow)
+{
+    flow_kind_t kind;
+    int target; // Line jumped to (loop header for done, past the construct when a condition fails or a for ends)
+    int iter;   // Index of the next item of a for loop
+};
+
+struct pcb_stats // Accounting of a process (see ps), times are in ns of the monotonic clock
+{
+    unsigned long long instructions; // Instructions executed
+    unsigned long long slices;       // Times the process was dispatched
+    unsigned long long faults;       // Times the process waited for a page-in
+    long long wait_ns;               // Time spent in the ready queue or blocked on a page-in
+    long long run_ns;                // Time spent as the running process
+    long long launched;              // Time the process was launched
+    long long materialized;          // Time the script was copied to the backing store (-1 while a stub)
+    long long queued_at;             // Time the process started waiting (-1 while it runs)
+};
+
 struct pcb
 {
     p_t pid;
     int bound;
     int pc;
+    int job;            // Job the process belongs to (see jobs.c)
+    int materialized;   // Indicator (1 once the script is in the backing store and the pagetable exists, see materialize_process)
+    char *script;       // File name of the script
     int *pagetable;
+    long *page_offsets; // Byte offset of the start of each page in the backing store file
+    struct flow_entry *flow; // Control flow of each line, NULL if the script has no control statements
+    struct parsed_line **lines; // Compiled lines of the script, pages are loaded from them (see cp_to_store, or
+                                // simulate), NULL while a stub
+    int owns_lines;             // Indicator (1 if lines are released with the process, 0 if the simulation shares them)
+    struct pcb_stats stats;
 };
 
 struct pcb *load_script(char *script);
+int materialize_process(struct pcb *pcb);
+int copy_script(struct pcb *pcb);
+int build_flow(struct pcb *pcb, struct flow_mark *marks, int n_marks);
 void load_page(struct pcb *pcb, int page);
 void free_process(struct pcb *pcb);
+flow_kind_t flow_keyword(const char *word, int len);
+const char *flow_keyword_name(flow_kind_t kind);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include <stdio.h>
+
+#include "policy.h"
+
+#define RR_PREEMPT_FREQ 2 // Number of lines to run before preempt for Round robin policy
+
+// Hooks shared by several policies
+
+/*
+ * Function:  enqueue_fifo
+ * --------------------
+ * Adds a process to the back of the running queue. Used by FCFS and RR.
+ */
+static void enqueue_fifo(struct pcb *p)
+{
+    rq_push(p, 0);
+}
+
+/*
+ * Function:  enqueue_shortest
+ * --------------------
+ * Adds a process to the running queue ordered by length (shortest first). Used by SJF.
+ */
+static void enqueue_shortest(struct pcb *p)
+{
+    rq_push(p, p->bound);
+}
+
+static void no_op() {}
+
+/*
+ * FCFS: Runs processes in the order they were added, each until it terminates
+ * SJF: Runs processes in order of length, each until it terminates
+ */
+DEFINE_SCHED_POLICY(fcfs, "FCFS", enqueue_fifo, pop_front, no_op, no_op, no_op)
+DEFINE_SCHED_POLICY(sjf, "SJF", enqueue_shortest, pop_front, no_op, no_op, no_op)
+
+/*
+ * RR: Runs current process for up to RR_PREEMPT_FREQ instructions and then places it at back of queue
+ */
+static int rr_slice; // Instructions executed by the current process since it was picked
+
+static void rr_pick_next()
+{
+    pop_front();
+    rr_slice = 0;
+}
+
+static void rr_on_tick()
+{
+    if (++rr_slice >= RR_PREEMPT_FREQ)
+        preempt_current(0); // Back of queue
+}
+
+DEFINE_SCHED_POLICY(rr, "RR", enqueue_fifo, rr_pick_next, rr_on_tick, no_op, no_op)
+
+/*
+ * AGING: Processes start with their length as priority (lower runs first). Every instruction executed decrements the
+ * priority of all waiting processes (down to 0), and the current process is preempted as soon as the head of the
+ * waiting queue has a strictly lower priority.
+ *
+ * Keys are stored as priority + aging_clock, so the effective priority of a queued process is max(0, key - aging_clock)
+ * and aging the whole queue is a single increment. Clamping at 0 keeps the queue order intact since it is monotonic
+ * in key.
+ */
+static long long aging_clock;   // Number of aging ticks so far
+static int aging_cur_priority;  // Priority of the current process (does not age while it runs)
+
+static int aging_priority(long long key)
+{
+    long long priority = key - aging_clock;
+    return priority > 0 ? (int)priority : 0;
+}
+
+static void aging_enqueue(struct pcb *p)
+{
+    rq_push(p, p->bound + aging_clock);
+}
+
+static void aging_pick_next()
+{
+    pop_front();
+    aging_cur_priority = aging_priority(current_key());
+}
+
+static void aging_tick()
+{
+    aging_clock++;
+}
+
+static void aging_on_tick()
+{
+    aging_tick();
+
+    // Head of waiting queue has higher priority than current running process. The current process goes back
+    // after every waiting process of equal priority
+    if (rq_size() > 0 && aging_priority(rq_head_key()) < aging_cur_priority)
+        preempt_current(aging_cur_priority + aging_clock);
+}
+
+DEFINE_SCHED_POLICY(aging, "AGING", aging_enqueue, aging_pick_next, aging_on_tick, aging_tick, aging_tick)
+
+// Registered policies (looked up by name, see find_policy)
+const struct sched_policy *sched_policies[] = {
+    &fcfs_policy,
+    &sjf_policy,
+    &rr_policy,
+    &aging_policy,
+    NULL};
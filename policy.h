@@ -0,0 +1,109 @@
+#ifndef POLICY_H
+#define POLICY_H
+#include "pcb.h"
+
+/*
+ * Scheduling policy interface.
+ *
+ * A policy decides where processes go in the ready queue and when the running process is preempted. The ready queue
+ * is a priority queue ordered by (key, insertion order), so FIFO policies push every process with the same key.
+ * Paging (blocking on page faults, page-ins, materializing process stubs) is handled by the scheduler for every policy.
+ *
+ * A policy is defined with DEFINE_SCHED_POLICY, which instantiates a run loop for it with the policy's hooks called
+ * directly (no per-instruction indirection), and is registered in the sched_policies table (policies.c).
+ *
+ * Hooks:
+ *   enqueue(struct pcb *p)  Adds a newly launched process to the ready queue (see rq_push)
+ *   pick_next()             Makes the next process from the ready queue the current process (see pop_front)
+ *   on_tick()               Called after the current process executed an instruction and is still running.
+ *                           May preempt it (see preempt_current). An instruction that waited for external programs
+ *                           uses several ticks (see instruction_ticks), on_tick is called for each of them until the
+ *                           process is preempted
+ *   on_fault()              Called after the current process faulted (it is already blocked waiting for its page),
+ *                           or was blocked on external programs left running for the prompt (see suspend_current)
+ *   on_exit()               Called after the current process executed its last instruction
+ */
+
+struct sched_policy
+{
+    const char *name;                                       // Name of policy (as given to exec)
+    void (*enqueue)(struct pcb *p);                         // enqueue hook
+    int (*run)(int budget, int (*stop)(int), int stop_arg); // Run loop (see DEFINE_SCHED_POLICY)
+};
+
+typedef enum // Outcome of executing one instruction of the current process
+{
+    EXEC_RAN,     // Instruction executed, process continues
+    EXEC_FAULTED, // Page fault, process is blocked
+    EXEC_EXITED   // Last instruction executed, process terminated
+} exec_result_t;
+
+extern const struct sched_policy *sched_policies[];
+
+// Scheduler functions available to policies (scheduler.c)
+void rq_push(struct pcb *data, long long key);
+int rq_size();
+long long rq_head_key();
+void pop_front();
+struct pcb *current_process();
+long long current_key();
+void preempt_current(long long key);
+int dispatch(void (*pick_next)());
+exec_result_t exec_instruction();
+int instruction_ticks();
+int processes_waiting();
+const struct sched_policy *current_policy();
+
+/*
+ * Macro:  DEFINE_SCHED_POLICY
+ * --------------------
+ * Defines the policy descriptor ident_policy and its run loop.
+ * The run loop executes up to budget instructions. Whenever no process is running it checks stop(stop_arg)
+ * (if stop is not NULL) and returns once it is true, otherwise dispatches the next process.
+ *
+ * It also returns when the policy changed (only possible once the last process exited).
+ *
+ * The run loop returns 0 on success, 1 if there is nothing left to run.
+ */
+#define DEFINE_SCHED_POLICY(ident, policy_name, enqueue, pick_next, on_tick, on_fault, on_exit) \
+    extern const struct sched_policy ident##_policy;                                            \
+    static int ident##_run(int budget, int (*stop)(int), int stop_arg)                          \
+    {                                                                                           \
+        while (budget > 0 && processes_waiting())                                               \
+        {                                                                                       \
+            if (current_process() == NULL)                                                      \
+            {                                                                                   \
+                if (stop != NULL && stop(stop_arg))                                             \
+                    return 0;                                                                   \
+                if (!dispatch(pick_next))                                                       \
+                    return 1;                                                                   \
+            }                                                                                   \
+                                                                                                \
+            budget--;                                                                           \
+            switch (exec_instruction())                                                         \
+            {                                                                                   \
+            case EXEC_RAN:                                                                      \
+                on_tick();                                                                      \
+                for (int ticks = instruction_ticks() - 1; ticks > 0; ticks--)                   \
+                {                                                                               \
+                    budget--;                                                                   \
+                    if (current_process() == NULL)                                              \
+                        break; /* Preempted */                                                  \
+                    on_tick();                                                                  \
+                }                                                                               \
+                break;                                                                          \
+            case EXEC_FAULTED:                                                                  \
+                on_fault();                                                                     \
+                break;                                                                          \
+            case EXEC_EXITED:                                                                   \
+                on_exit();                                                                      \
+                if (current_policy() != &ident##_policy)                                        \
+                    return 0; /* Last process launched processes under another policy */        \
+                break;                                                                          \
+            }                                                                                   \
+        }                                                                                       \
+        return 0;                                                                               \
+    }                                                                                           \
+    const struct sched_policy ident##_policy = {policy_name, enqueue, ident##_run};
+
+#endif
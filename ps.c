@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ps.h"
+#include "scheduler.h"
+#include "clock.h"
+#include "output.h"
+
+#define PS_EXITS "exits"             // ps argument turning the exit summaries on/off
+#define TOP_REFRESH_MS 1000          // Default time between two refreshes of top
+#define TOP_BUDGET 64                // Instructions run between two checks of the clock by top
+#define CLEAR_SCREEN "\033[H\033[2J" // Printed before each refresh of top on a terminal
+
+struct process_list // Live processes gathered with for_each_process
+{
+    struct pcb **procs;
+    int n;
+    int cap;
+};
+
+int report_exits = 0; // Indicator (1 if a summary is printed when a process exits, see "ps exits on")
+
+void add_to_list(struct pcb *p, void *arg);
+int gather_processes(struct process_list *list);
+int by_pid(const void *a, const void *b);
+int by_run_time(const void *a, const void *b);
+void print_process_table(struct process_list *list);
+int badcommandPs();
+int badcommandTop();
+
+/*
+ * Function:  report_process_exit
+ * --------------------
+ * Prints the accounting summary of a process that just terminated, if exit summaries are on (see ps)
+ *
+ * struct pcb *p: terminated process (not freed yet)
+ */
+void report_process_exit(struct pcb *p)
+{
+    if (!report_exits)
+        return;
+
+    long long now = monotonic_ns();
+    out_printf("Process %llu (%s) exited: %llu instructions, %llu slices, %llu faults, wait %.3f ms, run %.3f ms, "
+               "resident %.3f ms, turnaround %.3f ms\n",
+               p->pid, p->script, p->stats.instructions, p->stats.slices, p->stats.faults, p->stats.wait_ns / 1e6,
+               p->stats.run_ns / 1e6, p->stats.materialized != -1 ? (now - p->stats.materialized) / 1e6 : 0.0,
+               (now - p->stats.launched) / 1e6);
+}
+
+/*
+ * Function:  ps
+ * --------------------
+ * ps builtin: prints the accounting of every live process (see print_process_table), ordered by pid
+ *   ps                  prints the table
+ *   ps exits on|off     prints a summary whenever a process exits (off by default)
+ *
+ * char *args[]: arguments (without the command name)
+ * int n_args: number of arguments
+ *
+ * returns (int): status
+ */
+int ps(char *args[], int n_args)
+{
+    if (n_args == 2 && strcmp(args[0], PS_EXITS) == 0 && (strcmp(args[1], "on") == 0 || strcmp(args[1], "off") == 0))
+    {
+        report_exits = strcmp(args[1], "on") == 0;
+        return 0;
+    }
+    if (n_args != 0)
+        return badcommandPs();
+
+    struct process_list list = {NULL, 0, 0};
+    if (gather_processes(&list) != 0)
+        return 1;
+
+    qsort(list.procs, list.n, sizeof(struct pcb *), by_pid);
+    print_process_table(&list);
+    free(list.procs);
+    return 0;
+}
+
+/*
+ * Function:  top
+ * --------------------
+ * top builtin: runs the scheduler until every process has terminated, printing the process table (busiest
+ * processes first) every INTERVAL_MS milliseconds. Like wait, it can only be used at the prompt.
+ *
+ * char *args[]: arguments (without the command name), optionally INTERVAL_MS
+ * int n_args: number of arguments
+ *
+ * returns (int): status
+ */
+int top(char *args[], int n_args)
+{
+    long long interval = TOP_REFRESH_MS;
+
+    if (n_args == 1)
+        interval = atoll(args[0]);
+    if (n_args > 1 || interval <= 0)
+        return badcommandTop();
+    if (current_job() != -1)
+        return badcommandTop(); // Would recursively start the scheduler
+
+    int clear = isatty(STDOUT_FILENO);
+    interval *= 1000000; // ns
+
+    do
+    {
+        struct process_list list = {NULL, 0, 0};
+        if (gather_processes(&list) != 0)
+            return 1;
+        qsort(list.procs, list.n, sizeof(struct pcb *), by_run_time);
+
+        if (clear)
+            out_puts(CLEAR_SCREEN);
+        print_process_table(&list);
+        out_flush();
+        free(list.procs);
+
+        long long next = monotonic_ns() + interval;
+        while (processes_waiting() && monotonic_ns() < next)
+        {
+            if (run_scheduler_for(TOP_BUDGET, 0) != 0)
+                return 1;
+        }
+    } while (processes_waiting());
+
+    return 0;
+}
+
+/*
+ * Function:  print_process_table
+ * --------------------
+ * Prints one line per process: instructions executed, slices received, page faults, time spent waiting (ready queue
+ * and page-ins), running, with its script in the backing store (resident) and since launch (age), and progress (pc)
+ */
+void print_process_table(struct process_list *list)
+{
+    long long now = monotonic_ns();
+
+    out_printf("%-6s %-10s %-8s %-7s %-10s %-10s %-10s %-10s %-13s %s\n", "PID", "INSTR", "SLICES", "FAULTS",
+               "WAIT(ms)", "RUN(ms)", "RES(ms)", "AGE(ms)", "PC/LINES", "SCRIPT");
+    for (int i = 0; i < list->n; i++)
+    {
+        struct pcb *p = list->procs[i];
+        char progress[32];
+        snprintf(progress, sizeof(progress), "%d/%d", p->pc, p->bound);
+
+        long long wait = p->stats.wait_ns + (p->stats.queued_at != -1 ? now - p->stats.queued_at : 0);
+        double resident = p->stats.materialized != -1 ? (now - p->stats.materialized) / 1e6 : 0.0;
+
+        out_printf("%-6llu %-10llu %-8llu %-7llu %-10.3f %-10.3f %-10.3f %-10.3f %-13s %s\n", p->pid,
+                   p->stats.instructions, p->stats.slices, p->stats.faults, wait / 1e6, p->stats.run_ns / 1e6, resident,
+                   (now - p->stats.launched) / 1e6, progress, p->script);
+    }
+}
+
+/*
+ * Function:  gather_processes
+ * --------------------
+ * Lists the live processes
+ *
+ * struct process_list *list: empty list to fill (procs must be freed by caller)
+ *
+ * returns (int): status (0 on success, 1 if out of memory)
+ */
+int gather_processes(struct process_list *list)
+{
+    for_each_process(add_to_list, list);
+    return list->n < 0;
+}
+
+/*
+ * Function:  add_to_list
+ * --------------------
+ * for_each_process visitor appending a process to a struct process_list (n becomes -1 if out of memory)
+ */
+void add_to_list(struct pcb *p, void *arg)
+{
+    struct process_list *list = arg;
+    if (list->n < 0)
+        return;
+
+    if (list->n == list->cap)
+    {
+        int new_cap = list->cap == 0 ? 16 : list->cap * 2;
+        struct pcb **grown = realloc(list->procs, new_cap * sizeof(struct pcb *));
+        if (grown == NULL)
+        {
+            list->n = -1;
+            return;
+        }
+        list->procs = grown;
+        list->cap = new_cap;
+    }
+    list->procs[list->n++] = p;
+}
+
+int by_pid(const void *a, const void *b)
+{
+    const struct pcb *p = *(struct pcb *const *)a, *q = *(struct pcb *const *)b;
+    return (p->pid > q->pid) - (p->pid < q->pid);
+}
+
+int by_run_time(const void *a, const void *b)
+{
+    const struct pcb *p = *(struct pcb *const *)a, *q = *(struct pcb *const *)b;
+    return (p->stats.run_ns < q->stats.run_ns) - (p->stats.run_ns > q->stats.run_ns); // Busiest first
+}
+
+/*
+ * Function:  badcommandPs
+ * --------------------
+ * Indicates that ps was given arguments it does not understand
+ *
+ * returns (int): status
+ */
+int badcommandPs()
+{
+    out_printf("%s\n", "Bad command: Expected ps or ps exits on|off");
+    return 18;
+}
+
+/*
+ * Function:  badcommandTop
+ * --------------------
+ * Indicates that top was given a bad interval or was used by a running script
+ *
+ * returns (int): status
+ */
+int badcommandTop()
+{
+    out_printf("%s\n", "Bad command: Expected top [INTERVAL_MS] (at the prompt)");
+    return 19;
+}
@@ -0,0 +1,9 @@
+#ifndef PS_H
+#define PS_H
+#include "pcb.h"
+
+void report_process_exit(struct pcb *p);
+int ps(char *args[], int n_args);
+int top(char *args[], int n_args);
+
+#endif
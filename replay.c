@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+
+// Variables defined in makefile
+// FRAMESIZE, FRAMESTORESIZE, VARMEMSIZE
+
+#define LOG_MAGIC "MYSHLOG1"
+#define LOG_BUFFER_SIZE 65536 // Records are written through a buffer of this size, the log costs no syscall per record
+
+/*
+ * Log format: LOG_MAGIC, then the memory geometry (FRAMESIZE, FRAMESTORESIZE, VARMEMSIZE) since paging decisions
+ * depend on it, then one record per decision: kind (1 byte), pid and arg, both unsigned LEB128 varints. Most records
+ * take 3 bytes.
+ */
+
+struct log_state
+{
+    FILE *f;
+    const char *file;
+    unsigned long long n; // Number of records written or replayed
+} l_state;
+
+log_mode_t log_mode = LOG_OFF;
+
+const char *log_names[] = {"input", "script", "dispatch", "fault",   "preempt",
+                           "exit",  "ticks",  "continue", "suspend", "resume"}; // By log_record_t
+
+void log_close();
+void log_stop();
+void put_varint(unsigned long long v);
+int get_varint(unsigned long long *v);
+
+/*
+ * Function:  log_open
+ * --------------------
+ * Starts recording decisions to a log, or replaying the decisions of one. The log is closed at exit.
+ *
+ * const char *file: log file (not copied, must stay valid)
+ * log_mode_t mode: LOG_RECORD or LOG_REPLAY
+ *
+ * returns (int): status (0 on success, -1 if the log can not be opened or was recorded with another geometry)
+ */
+int log_open(const char *file, log_mode_t mode)
+{
+    unsigned long long geometry[3] = {FRAMESIZE, FRAMESTORESIZE, VARMEMSIZE};
+
+    // Close-on-exec ('e'): programs the shell starts must not inherit the log
+    l_state.f = fopen(file, mode == LOG_RECORD ? "wbe" : "rbe");
+    if (l_state.f == NULL)
+    {
+        perror(file);
+        return -1;
+    }
+    setvbuf(l_state.f, NULL, _IOFBF, LOG_BUFFER_SIZE);
+    l_state.file = file;
+    l_state.n = 0;
+
+    if (mode == LOG_RECORD)
+    {
+        fwrite(LOG_MAGIC, 1, strlen(LOG_MAGIC), l_state.f);
+        for (int i = 0; i < 3; i++)
+            put_varint(geometry[i]);
+    }
+    else
+    {
+        char magic[sizeof(LOG_MAGIC)] = {0};
+        unsigned long long recorded;
+        int ok = fread(magic, 1, strlen(LOG_MAGIC), l_state.f) == strlen(LOG_MAGIC) && strcmp(magic, LOG_MAGIC) == 0;
+        for (int i = 0; ok && i < 3; i++)
+            ok = get_varint(&recorded) == 0 && recorded == geometry[i];
+        if (!ok)
+        {
+            fprintf(stderr, "%s: not a decision log of a shell with frame size %d, frame store size %d and variable "
+                            "store size %d\n", file, FRAMESIZE, FRAMESTORESIZE, VARMEMSIZE);
+            fclose(l_state.f);
+            return -1;
+        }
+    }
+
+    log_mode = mode;
+    atexit(log_close);
+    return 0;
+}
+
+/*
+ * Function:  log_event
+ * --------------------
+ * Records a decision, or reads the next recorded one when replaying. A replayed record must be of the same kind and
+ * process; for forced kinds (dispatch, ticks, continue, suspend, resume) its arg is the decision to take, for the
+ * others it must match arg. Otherwise the run diverged from the log and replay stops (see log_diverged).
+ * Use LOG_EVENT or LOG_FORCE, which skip the call when the log is off.
+ *
+ * log_record_t kind: kind of decision
+ * p_t pid: process the decision is about (0 if none)
+ * unsigned long long arg: decision (see log_record_t)
+ *
+ * returns (unsigned long long): decision to take (the recorded one for forced kinds when replaying, arg otherwise)
+ */
+unsigned long long log_event(log_record_t kind, p_t pid, unsigned long long arg)
+{
+    if (log_mode == LOG_RECORD)
+    {
+        putc(kind, l_state.f);
+        put_varint(pid);
+        put_varint(arg);
+        l_state.n++;
+        return arg;
+    }
+
+    int forced = kind == LOG_DISPATCH || kind == LOG_TICKS || kind == LOG_CONTINUE || kind == LOG_SUSPEND ||
+                 kind == LOG_RESUME;
+    unsigned long long rec_pid, rec_arg;
+    int rec_kind = getc(l_state.f);
+
+    if (rec_kind == EOF || get_varint(&rec_pid) != 0 || get_varint(&rec_arg) != 0)
+    {
+        log_diverged("the log ended before the run");
+        return arg;
+    }
+    if (rec_kind != kind || rec_pid != pid || (!forced && rec_arg != arg))
+    {
+        char reason[200];
+        snprintf(reason, sizeof(reason), "log has %s pid %llu arg %llu, run has %s pid %llu arg %llu",
+                 rec_kind < (int)(sizeof(log_names) / sizeof(log_names[0])) ? log_names[rec_kind] : "?", rec_pid,
+                 rec_arg, log_names[kind], pid, arg);
+        log_diverged(reason);
+        return arg;
+    }
+
+    l_state.n++;
+    return forced ? rec_arg : arg;
+}
+
+/*
+ * Function:  log_diverged
+ * --------------------
+ * Reports that the replayed run no longer follows the log, and stops replaying (the run continues on its own)
+ *
+ * const char *reason: what differs
+ */
+void log_diverged(const char *reason)
+{
+    fprintf(stderr, "Replay of %s diverged after %llu records: %s\n", l_state.file, l_state.n, reason);
+    log_stop();
+}
+
+/*
+ * Function:  log_close
+ * --------------------
+ * Writes out the rest of a recorded log, or reports whether a replayed run followed the whole log (on stderr, so the
+ * output of a replayed run can be compared with the recorded one)
+ */
+void log_close()
+{
+    if (log_mode == LOG_REPLAY)
+    {
+        if (getc(l_state.f) != EOF)
+        {
+            log_diverged("the run ended before the log");
+            return;
+        }
+        fprintf(stderr, "Replay of %s complete: %llu records matched\n", l_state.file, l_state.n);
+    }
+    log_stop();
+}
+
+/*
+ * Function:  log_stop
+ * --------------------
+ * Closes the log
+ */
+void log_stop()
+{
+    if (log_mode == LOG_OFF)
+        return;
+    log_mode = LOG_OFF;
+    if (fclose(l_state.f) != 0)
+        perror(l_state.file);
+}
+
+/*
+ * Function:  log_checksum
+ * --------------------
+ * FNV-1a checksum of inputs (lines, scripts), so a replay can tell that it is given the recorded inputs.
+ * Can be computed incrementally: pass the result of the previous part as h (LOG_CHECKSUM_INIT for the first).
+ *
+ * returns (unsigned int): checksum
+ */
+unsigned int log_checksum(unsigned int h, const void *data, size_t len)
+{
+    const unsigned char *c = data;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= c[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+ * Function:  put_varint
+ * --------------------
+ * Writes a value as an unsigned LEB128 varint (7 bits per byte, high bit set on every byte but the last)
+ */
+void put_varint(unsigned long long v)
+{
+    while (v >= 0x80)
+    {
+        putc((int)(v & 0x7f) | 0x80, l_state.f);
+        v >>= 7;
+    }
+    putc((int)v, l_state.f);
+}
+
+/*
+ * Function:  get_varint
+ * --------------------
+ * Reads a value written by put_varint
+ *
+ * returns (int): status (0 on success, -1 at the end of the log)
+ */
+int get_varint(unsigned long long *v)
+{
+    int c, shift = 0;
+
+    *v = 0;
+    do
+    {
+        if ((c = getc(l_state.f)) == EOF || shift > 63)
+            return -1;
+        *v |= (unsigned long long)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+#include <stddef.h>
+#include "pcb.h"
+
+typedef enum // Mode of the decision log (see log_open)
+{
+    LOG_OFF,
+    LOG_RECORD, // Decisions are written to the log
+    LOG_REPLAY  // Decisions are read from the log: forced ones are taken from it, the others are checked against it
+} log_mode_t;
+
+typedef enum // Records of the decision log (see log_event)
+{
+    LOG_INPUT,    // Input run by the main loop: a line, batch commands or a script sourced at the prompt (arg: checksum)
+    LOG_SCRIPT,   // Script copied into the backing store for a process (pid, arg: checksum of the script)
+    LOG_DISPATCH, // Process taken from the ready queue to run (arg: its pid), forced when replaying
+    LOG_FAULT,    // Process blocked on a page fault (pid, arg: page)
+    LOG_PREEMPT,  // Running process put back into the ready queue (pid)
+    LOG_EXIT,     // Process terminated (pid, arg: pc)
+    LOG_TICKS,    // Time slice ticks charged for external programs (pid, arg: ticks), forced when replaying
+    LOG_CONTINUE, // Background processes keep running (arg 1) or stop for pending input (arg 0), forced when replaying
+    LOG_SUSPEND,  // External programs of a background instruction left running for pending input (arg 1) or waited for
+                  // (arg 0), forced when replaying
+    LOG_RESUME    // External programs of a suspended instruction exited (pid, arg 1) or still run (arg 0), forced when
+                  // replaying
+} log_record_t;
+
+#define LOG_CHECKSUM_INIT 2166136261u // Start value of log_checksum
+
+extern log_mode_t log_mode; // Read directly by LOG_EVENT and LOG_FORCE
+
+/*
+ * Macro:  LOG_EVENT
+ * --------------------
+ * Records a decision, or checks it against the log when replaying. When the log is off this is a single test of a
+ * global, nothing else is evaluated.
+ */
+#define LOG_EVENT(kind, pid, arg)            \
+    do                                       \
+    {                                        \
+        if (log_mode != LOG_OFF)             \
+            log_event((kind), (pid), (arg)); \
+    } while (0)
+
+/*
+ * Macro:  LOG_FORCE
+ * --------------------
+ * Records a decision and evaluates to it (arg), or to the recorded decision when replaying
+ */
+#define LOG_FORCE(kind, pid, arg) (log_mode != LOG_OFF ? log_event((kind), (pid), (arg)) : (arg))
+
+int log_open(const char *file, log_mode_t mode);
+unsigned long long log_event(log_record_t kind, p_t pid, unsigned long long arg);
+void log_diverged(const char *reason);
+unsigned int log_checksum(unsigned int h, const void *data, size_t len);
+
+#endif
@@ -1,27 +1,68 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 
 #include "scheduler.h"
+#include "policy.h"
 #include "pcb.h"
 #include "shellmemory.h"
 #include "shell.h"
-
-#define RR_PREEMPT_FREQ 2 // Number of lines to run before preempt for Round robin policy
-
-struct ll // linked list representing process waiting queue
+#include "jobs.h"
+#include "interpreter.h"
+#include "output.h"
+#include "trace.h"
+#include "clock.h"
+#include "ps.h"
+#include "replay.h"
+#include "timing.h"
+#include "simulate.h"
+#include "spawn.h"
+
+#define SCHED_LOOKAHEAD 4 // Max number of non-resident processes skipped when looking for a process to dispatch
+#define EXTERNAL_TICK_US 1000 // Time waiting for external programs charged to a process as one time slice tick
+
+// Skipped processes have their pages loaded together at the next dispatch, fewer than NFRAMES loads guarantees
+// that the first of them is still resident afterwards
+#define LOOKAHEAD (SCHED_LOOKAHEAD < NFRAMES - 1 ? SCHED_LOOKAHEAD : NFRAMES - 1)
+
+struct rq_entry // element of the ready queue (binary min-heap ordered by (key, seq))
 {
     struct pcb *p;
-    int priority;
-    struct ll *next;
+    long long key;          // Priority key assigned by the policy (equal for every process in FIFO policies)
+    unsigned long long seq; // Insertion sequence number, breaks ties so that equal keys keep FIFO order
+};
+
+struct suspended_instr // Instruction of a background job whose external programs still run (see suspend_current)
+{
+    struct rq_entry entry;    // Ready queue entry its process returns with (p is NULL if the process terminated)
+    p_t pid;                  // Process the instruction belongs to
+    int job;                  // Job of the process
+    struct parsed_line *line; // Line of the instruction (held until it is done)
+    int next_cmd;             // Index in line of the first command still to run
+    struct pipeline *pl;      // External programs being waited for (see take_suspended)
 };
 
 struct scheduler_state // State of Scheduler
 {
-    int np;                 // Number of processes currently running (includes current process and all processes in queue)
-    struct ll *head, *tail; // head and tail pointers of linked list
-    struct pcb *cur;        // Current running process (note: this process is popped from queue while it is running)
-    int cur_priority;       // Priority of the current process
-    sched_mode_t mode;      // Current scheduling policy
+    int np;                            // Number of processes currently running (includes current process and all processes in queue)
+    struct rq_entry *heap;             // Ready queue, stored as an array backed binary heap
+    int rq_size;                       // Number of processes in the ready queue
+    int rq_cap;                        // Allocated capacity of heap
+    unsigned long long seq;            // Next insertion sequence number
+    struct pcb *cur;                   // Current running process (note: this process is popped from queue while it is running)
+    struct rq_entry cur_rq;            // Ready queue entry the current process was popped with (used to requeue it in place)
+    struct rq_entry *blocked;          // Processes waiting for a page-in (FIFO), they keep their ready queue entries
+    int n_blocked;                     // Number of processes in blocked
+    int blocked_cap;                   // Allocated capacity of blocked
+    const struct sched_policy *policy; // Current scheduling policy (NULL until one is selected)
+    int exec_job;                      // Job of the process whose instruction is being executed (-1 when not executing a process)
+    int instr_ticks;                   // Time slice ticks used by the instruction being executed (see charge_external_time)
+    long long running_since;           // Time the current process started running (-1 if its run time is not being measured)
+    struct suspended_instr *suspended; // Instructions waiting for external programs (FIFO), see suspend_current
+    int n_suspended;                   // Number of instructions in suspended
+    int suspended_cap;                 // Allocated capacity of suspended
+    int interleaving;                  // 1 while the prompt waits for input (see run_scheduler_for)
 } state;
 
 // Error functions
@@ -29,34 +70,57 @@ void error_too_many_processes();
 void error_process_not_found();
 void error_bad_mode_switch();
 void error_no_mode_selected();
+void error_materialize_failed(struct pcb *p);
 
-// private functions
-void exec_process();
-void run_AGING();
-void run_RR();
-void run_basic();
+// Ready Queue Funcs
+int rq_less(struct rq_entry *a, struct rq_entry *b);
+void rq_insert(struct rq_entry e);
+void rq_sift_up(int i);
+void rq_sift_down(int i);
+int rq_find(p_t pid);
 
-// Linked List Funcs
-void add_with_priority(struct pcb *data, int priority);
-void add_back(struct pcb *data);
-void pop_front();
-void decr_priorities();
+// Accounting Funcs
+void stop_running(long long now);
+void process_exited(struct pcb *p);
+int run_policy(int budget, int (*stop)(int), int stop_arg, int interleave);
+
+// Paging Funcs
+void block_current();
+void complete_page_ins();
+int prepare_current();
+
+// External program Funcs
+void suspend_current(struct parsed_line *line, int at, int job, p_t pid);
+void add_suspended(struct suspended_instr s);
+void resume_suspended(int block);
+
+// Run loop stop conditions
+int no_foreground_jobs(int unused);
 
 /*
  * Function:  init_scheduler
  * --------------------
  * Initialize the scheduler state.
- *
- * int framenum: frame to find
  */
 void init_scheduler()
 {
     state.np = 0;
-    state.head = NULL;
-    state.tail = NULL;
+    state.heap = NULL;
+    state.rq_size = 0;
+    state.rq_cap = 0;
+    state.seq = 0;
     state.cur = NULL;
-    state.cur_priority = 0;
-    state.mode = NONE;
+    state.blocked = NULL;
+    state.n_blocked = 0;
+    state.blocked_cap = 0;
+    state.policy = NULL;
+    state.exec_job = -1;
+    state.instr_ticks = 1;
+    state.running_since = -1;
+    state.suspended = NULL;
+    state.n_suspended = 0;
+    state.suspended_cap = 0;
+    state.interleaving = 0;
 }
 
 /*
@@ -68,20 +132,139 @@ void init_scheduler()
  */
 int processes_waiting()
 {
-    return state.np > 0;
+    return state.np > 0 || state.n_suspended > 0;
+}
+
+/*
+ * Function:  processes_runnable
+ * --------------------
+ * Indicates if the scheduler has a process to run right away (not only instructions waiting for external programs)
+ *
+ * returns (int): Indicator (1 if a process is running, ready or waiting for a page-in, 0 otherwise)
+ */
+int processes_runnable()
+{
+    return state.cur != NULL || state.rq_size > 0 || state.n_blocked > 0;
+}
+
+/*
+ * Function:  external_may_suspend
+ * --------------------
+ * Indicates if the external programs of the instruction being executed may be left running (see run_external).
+ * Only instructions of background jobs run while the prompt waits for input are suspended, so their programs do not
+ * hold up the prompt.
+ *
+ * returns (int): Indicator (1 if the instruction may be suspended, 0 if its programs must be waited for)
+ */
+int external_may_suspend()
+{
+    return state.interleaving && state.exec_job != -1;
+}
+
+/*
+ * Function:  current_job
+ * --------------------
+ * Indicates which job the instruction currently being executed belongs to
+ *
+ * returns (int): job id, or -1 if no process instruction is being executed (e.g. command typed at the prompt)
+ */
+int current_job()
+{
+    return state.exec_job;
 }
 
 /*
- * Function:  set_scheduler_mode
+ * Function:  charge_external_time
+ * --------------------
+ * Charges the time spent waiting for external programs to the process whose instruction started them, one extra time
+ * slice tick per EXTERNAL_TICK_US microseconds, so a process running long programs is preempted like one executing
+ * many instructions. Time spent outside of a process (command typed at the prompt) is not charged.
+ *
+ * long long ns: time spent in nanoseconds
+ */
+void charge_external_time(long long ns)
+{
+    if (state.exec_job == -1)
+        return;
+
+    long long ticks = ns / (EXTERNAL_TICK_US * 1000LL);
+    state.instr_ticks += LOG_FORCE(LOG_TICKS, state.cur != NULL ? state.cur->pid : 0, ticks); // Timing varies by run
+}
+
+/*
+ * Function:  instruction_ticks
+ * --------------------
+ * returns (int): number of time slice ticks used by the last executed instruction (1 unless it ran external programs)
+ */
+int instruction_ticks()
+{
+    return state.instr_ticks;
+}
+
+/*
+ * Function:  for_each_process
+ * --------------------
+ * Calls visit for every live process: the current process, then the ready queue (in heap order, not in the order
+ * processes will run), then the processes blocked on a page-in or on external programs
+ *
+ * void (*visit)(struct pcb *p, void *arg): function to call
+ * void *arg: passed to visit
+ */
+void for_each_process(void (*visit)(struct pcb *p, void *arg), void *arg)
+{
+    if (state.cur != NULL)
+        visit(state.cur, arg);
+    for (int i = 0; i < state.rq_size; i++)
+        visit(state.heap[i].p, arg);
+    for (int i = 0; i < state.n_blocked; i++)
+        visit(state.blocked[i].p, arg);
+    for (int i = 0; i < state.n_suspended; i++)
+    {
+        if (state.suspended[i].entry.p != NULL)
+            visit(state.suspended[i].entry.p, arg);
+    }
+}
+
+/*
+ * Function:  find_policy
+ * --------------------
+ * Looks up a registered scheduling policy by name (see sched_policies in policies.c)
+ *
+ * const char *name: name of policy
+ *
+ * returns (const struct sched_policy *): policy, NULL if no policy has that name
+ */
+const struct sched_policy *find_policy(const char *name)
+{
+    for (int i = 0; sched_policies[i] != NULL; i++)
+    {
+        if (strcmp(sched_policies[i]->name, name) == 0)
+            return sched_policies[i];
+    }
+    return NULL;
+}
+
+/*
+ * Function:  current_policy
+ * --------------------
+ * returns (const struct sched_policy *): current scheduling policy (NULL if none is selected yet)
+ */
+const struct sched_policy *current_policy()
+{
+    return state.policy;
+}
+
+/*
+ * Function:  set_scheduler_policy
  * --------------------
  * Attempts to switch the scheduler policy to new policy.
- * There must be no processes running to switch scheduler mode
+ * There must be no processes running to switch scheduler policy
  *
  * returns (int): Indicator (0 on success, 1 on failure)
  */
-int set_scheduler_mode(sched_mode_t new_mode)
+int set_scheduler_policy(const struct sched_policy *new_policy)
 {
-    if (state.mode == new_mode) // If new mode same as old mode, no change made
+    if (state.policy == new_policy) // If new policy same as old policy, no change made
         return 0;
 
     if (state.np != 0) // There is a non-zero number of processes currently running, can't change policy
@@ -90,157 +273,495 @@ int set_scheduler_mode(sched_mode_t new_mode)
         return 1;
     }
 
-    state.mode = new_mode;
+    state.policy = new_policy;
     return 0;
 }
 
 /*
- * Function:  add_back
+ * Function:  rq_less
+ * --------------------
+ * Ordering used by the ready queue heap. Entries are ordered by key, entries with equal keys
+ * are ordered by insertion sequence (so equal keys behave like a regular FIFO queue).
+ *
+ * returns (int): 1 if a should run before b, 0 otherwise
+ */
+int rq_less(struct rq_entry *a, struct rq_entry *b)
+{
+    if (a->key != b->key)
+        return a->key < b->key;
+    return a->seq < b->seq;
+}
+
+/*
+ * Function:  rq_insert
+ * --------------------
+ * Inserts an entry into the ready queue heap. The heap array grows geometrically when full.
+ * Operation is O(log n) (amortized)
+ *
+ * struct rq_entry e: entry to insert
+ */
+void rq_insert(struct rq_entry e)
+{
+    if (state.rq_size == state.rq_cap)
+    {
+        int new_cap = state.rq_cap == 0 ? 16 : state.rq_cap * 2;
+        struct rq_entry *new_heap = realloc(state.heap, new_cap * sizeof(struct rq_entry));
+        if (new_heap == NULL)
+        {
+            error_too_many_processes();
+            exit(3);
+        }
+        state.heap = new_heap;
+        state.rq_cap = new_cap;
+    }
+
+    TRACE_EVENT(TRACE_ENQUEUE, e.p->pid, e.key);
+
+    state.heap[state.rq_size] = e;
+    rq_sift_up(state.rq_size++);
+}
+
+/*
+ * Function:  rq_sift_up
  * --------------------
- * Add a new process pcb to the back of the running queue. Creates new linked list
- * struct to store pcb. Used by RR and FCFS policies.
- * Used for regular queue operations.
- * Operation is O(1)
+ * Restores the heap property for the path from index i to the root
  *
- * Note: should not be used in conjuction with add_with_priority since this function assigns a non-sense priority value
+ * int i: index of the element to sift up
+ */
+void rq_sift_up(int i)
+{
+    struct rq_entry e = state.heap[i];
+
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (!rq_less(&e, &state.heap[parent]))
+            break;
+        state.heap[i] = state.heap[parent];
+        i = parent;
+    }
+    state.heap[i] = e;
+}
+
+/*
+ * Function:  rq_push
+ * --------------------
+ * Adds a process to the ready queue, behind every queued process with a lower or equal key
+ * Operation is O(log n)
  *
  * struct pcb *data: pcb of process to add to queue
+ * long long key: heap key of the process
  */
-void add_back(struct pcb *data)
+void rq_push(struct pcb *data, long long key)
 {
     if (data == NULL)
     {
         return; // Bad pcb as input (this should never happen)
     }
-    struct ll *newNode = malloc(sizeof(struct ll));
-    newNode->p = data;
-    newNode->next = NULL;
-    newNode->priority = -1;
-    if (state.head == NULL && state.tail == NULL)
+    struct rq_entry e = {data, key, state.seq++};
+    rq_insert(e);
+}
+
+/*
+ * Function:  rq_sift_down
+ * --------------------
+ * Restores the heap property for the subtree rooted at index i
+ *
+ * int i: index of the element to sift down
+ */
+void rq_sift_down(int i)
+{
+    struct rq_entry e = state.heap[i];
+    int n = state.rq_size;
+
+    while (2 * i + 1 < n)
     {
-        state.head = newNode;
-        state.tail = newNode;
+        int child = 2 * i + 1;
+        if (child + 1 < n && rq_less(&state.heap[child + 1], &state.heap[child]))
+            child++;
+        if (!rq_less(&state.heap[child], &e))
+            break;
+        state.heap[i] = state.heap[child];
+        i = child;
     }
-    else if (state.head == NULL || state.tail == NULL)
+    state.heap[i] = e;
+}
+
+/*
+ * Function:  rq_size
+ * --------------------
+ * returns (int): number of processes in the ready queue (excludes the current process and blocked processes)
+ */
+int rq_size()
+{
+    return state.rq_size;
+}
+
+/*
+ * Function:  rq_head_key
+ * --------------------
+ * returns (long long): key of the process at the head of the ready queue (the queue must not be empty)
+ */
+long long rq_head_key()
+{
+    return state.heap[0].key;
+}
+
+/*
+ * Function:  pop_front
+ * --------------------
+ * Removes the head process from the waiting queue and sets it as the current running process.
+ * When replaying a decision log, the recorded process is removed instead (see log_event).
+ * Operation takes O(log n) time
+ */
+void pop_front()
+{
+    if (state.rq_size == 0)
     {
-        // Unstable linked list state (should never happen)
-        exit(3);
+        error_process_not_found();
+        return;
     }
-    else
+
+    int i = 0;
+    if (log_mode != LOG_OFF)
     {
-        state.tail->next = newNode;
-        state.tail = newNode;
+        // When replaying, the recorded process runs next even if the queue order differs
+        p_t pid = log_event(LOG_DISPATCH, 0, state.heap[0].p->pid);
+        if (pid != state.heap[0].p->pid && (i = rq_find(pid)) == -1)
+        {
+            log_diverged("dispatched process is not in the ready queue");
+            i = 0;
+        }
+    }
+
+    state.cur = state.heap[i].p;
+    state.cur_rq = state.heap[i];
+    TRACE_EVENT(TRACE_DEQUEUE, state.cur->pid, state.cur_rq.key);
+
+    long long now = monotonic_ns();
+    state.cur->stats.wait_ns += now - state.cur->stats.queued_at;
+    state.cur->stats.queued_at = -1;
+    state.running_since = now;
+
+    state.heap[i] = state.heap[--state.rq_size];
+    if (i < state.rq_size)
+    {
+        rq_sift_up(i); // The moved entry may belong above i (only when it is not the head)
+        rq_sift_down(i);
     }
 }
 
 /*
- * Function:  add_with_priority
+ * Function:  rq_find
  * --------------------
- * Adds a new process pcb into it's correct location in the priority running queue. Creates a new linked list
- * struct to store the pcb and set's is priority to the given priority value.
- * Used for priority queue operations.
- * Operation is O(n)
+ * Finds a process in the ready queue (linear search, only used when replaying)
  *
- * Note: should not be used in conjunction with add_back since this function assumes the queue is a sorted priority queue
+ * p_t pid: process id
  *
- * struct pcb *data: pcb of process to add to queue
- * int priority: priority of added process
+ * returns (int): heap index of the process, -1 if it is not queued
  */
-void add_with_priority(struct pcb *data, int priority)
+int rq_find(p_t pid)
 {
-    if (data == NULL)
+    for (int i = 0; i < state.rq_size; i++)
     {
-        printf("What\n");
+        if (state.heap[i].p->pid == pid)
+            return i;
     }
-    struct ll *newNode = malloc(sizeof(struct ll));
-    newNode->p = data;
-    newNode->next = NULL;
-    newNode->priority = priority;
+    return -1;
+}
 
-    if (state.head == NULL)
+/*
+ * Function:  current_process
+ * --------------------
+ * returns (struct pcb *): current running process (NULL if none)
+ */
+struct pcb *current_process()
+{
+    return state.cur;
+}
+
+/*
+ * Function:  current_key
+ * --------------------
+ * returns (long long): key the current process had in the ready queue when it was picked
+ */
+long long current_key()
+{
+    return state.cur_rq.key;
+}
+
+/*
+ * Function:  preempt_current
+ * --------------------
+ * Places the current process back into the ready queue, behind every queued process with a lower or equal key
+ *
+ * long long key: new heap key of the process
+ */
+void preempt_current(long long key)
+{
+    TRACE_EVENT(TRACE_PREEMPT, state.cur->pid, key);
+    LOG_EVENT(LOG_PREEMPT, state.cur->pid, 0);
+    long long now = monotonic_ns();
+    stop_running(now);
+    state.cur->stats.queued_at = now;
+    rq_push(state.cur, key);
+    state.cur = NULL;
+}
+
+/*
+ * Function:  block_current
+ * --------------------
+ * Moves the current process (whose next page is not resident) to the blocked queue.
+ * Its page is loaded at the next dispatch, after which it returns to the position in the ready queue it was popped from.
+ */
+void block_current()
+{
+    if (state.n_blocked == state.blocked_cap)
     {
-        state.head = newNode;
-        return;
+        int new_cap = state.blocked_cap == 0 ? 8 : state.blocked_cap * 2;
+        struct rq_entry *grown = realloc(state.blocked, new_cap * sizeof(struct rq_entry));
+        if (grown == NULL)
+        {
+            error_too_many_processes();
+            exit(3);
+        }
+        state.blocked = grown;
+        state.blocked_cap = new_cap;
     }
 
-    if (priority < state.head->priority)
+    TRACE_EVENT(TRACE_FAULT, state.cur->pid, state.cur->pc / FRAMESIZE);
+    LOG_EVENT(LOG_FAULT, state.cur->pid, state.cur->pc / FRAMESIZE);
+    long long now = monotonic_ns();
+    stop_running(now);
+    state.cur->stats.queued_at = now;
+    state.cur->stats.faults++;
+    TIMING_COUNT(faults);
+
+    state.cur_rq.p = state.cur;
+    state.blocked[state.n_blocked++] = state.cur_rq;
+    state.cur = NULL;
+}
+
+/*
+ * Function:  complete_page_ins
+ * --------------------
+ * Loads the pages every blocked process is waiting for and moves those processes back to their original
+ * positions in the ready queue
+ */
+void complete_page_ins()
+{
+    for (int i = 0; i < state.n_blocked; ++i)
     {
-        newNode->next = state.head;
-        state.head = newNode;
-        return;
+        struct pcb *p = state.blocked[i].p;
+        load_page(p, p->pc / FRAMESIZE);
+        rq_insert(state.blocked[i]);
     }
+    state.n_blocked = 0;
+}
+
+/*
+ * Function:  prepare_current
+ * --------------------
+ * Materializes the current process if it is still a stub (see load_script). Processes that fail to materialize
+ * are terminated.
+ *
+ * returns (int): Indicator (1 if the current process can run, 0 if it was terminated)
+ */
+int prepare_current()
+{
+    if (state.cur->materialized || materialize_process(state.cur) == 0)
+        return 1;
 
-    struct ll *cur = state.head;
-    while (cur->next != NULL && cur->next->priority <= priority)
+    error_materialize_failed(state.cur);
+    TRACE_EVENT(TRACE_EXIT, state.cur->pid, state.cur->pc);
+    LOG_EVENT(LOG_EXIT, state.cur->pid, state.cur->pc);
+    process_exited(state.cur);
+
+    int job = state.cur->job;
+    free_process(state.cur);
+    state.cur = NULL;
+    state.np--;
+    job_process_finished(job);
+
+    if (state.np == 0)
     {
-        cur = cur->next;
+        mem_reset_frames(); // All processes done, reset frames
     }
+    return 0;
+}
 
-    newNode->next = cur->next;
-    cur->next = newNode;
-    if (cur == state.tail)
-        state.tail = newNode;
+/*
+ * Function:  suspend_current
+ * --------------------
+ * Sets aside an instruction whose external programs were left running (see run_external). The current process, if
+ * it did not terminate with this instruction, is blocked until they exited. The rest of the line then runs and the
+ * process returns to the position in the ready queue it was popped from (see resume_suspended).
+ *
+ * struct parsed_line *line: line of the instruction (the reference of the caller is taken over)
+ * int at: index in line of the suspended command
+ * int job: job of the process
+ * p_t pid: process the instruction belongs to
+ */
+void suspend_current(struct parsed_line *line, int at, int job, p_t pid)
+{
+    struct suspended_instr s = {{NULL, 0, 0}, pid, job, line, at + 1, take_suspended()};
+
+    if (state.cur != NULL)
+    {
+        long long now = monotonic_ns();
+        stop_running(now);
+        state.cur->stats.queued_at = now;
+        state.cur_rq.p = state.cur;
+        s.entry = state.cur_rq;
+        state.cur = NULL;
+    }
+    add_suspended(s);
+}
+
+/*
+ * Function:  add_suspended
+ * --------------------
+ * Appends an instruction to the suspended instructions. The array grows geometrically when full.
+ *
+ * struct suspended_instr s: instruction to add
+ */
+void add_suspended(struct suspended_instr s)
+{
+    if (state.n_suspended == state.suspended_cap)
+    {
+        int new_cap = state.suspended_cap == 0 ? 8 : state.suspended_cap * 2;
+        struct suspended_instr *grown = realloc(state.suspended, new_cap * sizeof(struct suspended_instr));
+        if (grown == NULL)
+        {
+            error_too_many_processes();
+            exit(3);
+        }
+        state.suspended = grown;
+        state.suspended_cap = new_cap;
+    }
+    state.suspended[state.n_suspended++] = s;
 }
 
 /*
- * Function:  decr_priorities
+ * Function:  resume_suspended
  * --------------------
- * Decrements the priority of all processes in the waiting queue.
- * Operation takes O(n) time.
+ * Finishes the suspended instructions whose external programs exited: the rest of their line runs (and may be
+ * suspended again), then their process returns to the ready queue, or its job is told the process finished.
+ *
+ * int block: 1 to wait for the programs of the oldest suspended instruction
  */
-void decr_priorities()
+void resume_suspended(int block)
 {
-    struct ll *cur = state.head;
+    int i = 0;
 
-    while (cur != NULL)
+    while (i < state.n_suspended)
     {
-        if (cur->priority > 0)
-            cur->priority--;
+        struct suspended_instr s = state.suspended[i];
+
+        // Whether the programs exited by now depends on timing
+        if (!LOG_FORCE(LOG_RESUME, s.pid, external_done(s.pl, block && i == 0)))
+        {
+            i++;
+            continue;
+        }
+        free_suspended(s.pl); // Waits for them if a replayed log has them exited already
+
+        // Removed before the rest of the line runs, which may itself run the scheduler (e.g. wait)
+        state.n_suspended--;
+        memmove(&state.suspended[i], &state.suspended[i + 1], (state.n_suspended - i) * sizeof(struct suspended_instr));
 
-        cur = cur->next;
+        int saved_job = state.exec_job;
+        state.exec_job = s.job; // Processes launched by the rest of the line join its job
+        int at = run_parsed_line(s.line, s.next_cmd);
+        state.exec_job = saved_job;
+
+        if (at != -1)
+        {
+            s.next_cmd = at + 1;
+            s.pl = take_suspended();
+            add_suspended(s); // Its process stays blocked
+            continue;
+        }
+        release_line(s.line);
+        if (s.entry.p != NULL)
+            rq_insert(s.entry);
+        else
+            job_process_finished(s.job);
     }
 }
 
 /*
- * Function:  pop_front
+ * Function:  dispatch
  * --------------------
- * Removes the head process from the waiting queue and sets it as the current running process.
- * Operation takes O(1) time
+ * Selects the next process to run with the policy's pick_next hook. Pending page-ins and instructions whose external
+ * programs exited complete first, and stubs are materialized when first picked. If only suspended instructions are
+ * left, their programs are waited for, unless the prompt is waiting for input (the caller then polls for both).
+ * Processes whose next page is resident are preferred: up to LOOKAHEAD non-resident processes at the head of the
+ * queue are blocked (and their pages requested) in favour of the first resident one behind them. If none is found,
+ * the pages are loaded right away and the head runs.
+ *
+ * void (*pick_next)(): policy hook making the next process of the ready queue the current process
+ *
+ * returns (int): Indicator (1 if a process was dispatched, 0 if there is nothing left to run)
  */
-void pop_front()
+int dispatch(void (*pick_next)())
 {
-    if (state.head == NULL)
+    resume_suspended(0);
+    while (!state.interleaving && state.n_suspended > 0 && state.rq_size == 0 && state.n_blocked == 0)
+        resume_suspended(1);
+    complete_page_ins();
+
+    int skipped = 0;
+    while (skipped < LOOKAHEAD && state.rq_size > 0)
     {
-        error_process_not_found();
-        return;
+        pick_next();
+        if (!prepare_current())
+            continue;
+        if (page_resident(state.cur, state.cur->pc / FRAMESIZE))
+        {
+            state.cur->stats.slices++;
+            TIMING_COUNT(dispatches);
+            return 1;
+        }
+        block_current();
+        skipped++;
     }
-    struct ll *curHead = state.head;
-    state.head = curHead->next;
-    state.cur = curHead->p;
-    state.cur_priority = curHead->priority;
-    if (state.tail == curHead)
-        state.tail = NULL;
-    free(curHead);
+
+    if (state.n_blocked == 0)
+        return 0; // Nothing left to run
+
+    complete_page_ins(); // Nothing resident to run, wait for the page-ins
+    pick_next();         // Head is the first blocked process, so it is already materialized
+    if (state.cur == NULL)
+        return 0;
+    state.cur->stats.slices++;
+    TIMING_COUNT(dispatches);
+    return 1;
 }
 
 void error_process_not_found()
 {
-    printf("Error: Expected a process on queue but found none!\n");
+    out_printf("Error: Expected a process on queue but found none!\n");
 }
 
 void error_too_many_processes()
 {
-    printf("Error: Attempted to launch too many concurrent processes.\n");
+    out_printf("Error: Attempted to launch too many concurrent processes.\n");
 }
 
 void error_bad_mode_switch()
 {
-    printf("Error: Attempted to switch mode while processes are running.\n");
+    out_printf("Error: Attempted to switch mode while processes are running.\n");
+}
+
+void error_materialize_failed(struct pcb *p)
+{
+    out_printf("Error: Failed to load script %s into memory.\n", p->script);
 }
 
 void error_no_mode_selected()
 {
-    printf("Error: You must selected a scheduler mode before running processes.\n");
+    out_printf("Error: You must selected a scheduler mode before running processes.\n");
 }
 
 /*
@@ -250,151 +771,213 @@ void error_no_mode_selected()
  */
 void add_process(struct pcb *new_p)
 {
-    switch (state.mode)
+    if (state.policy == NULL)
     {
-    case FCFS:
-    case RR:
-        add_back(new_p);
-        break;
-
-    case SJF:
-    case AGING:
-        add_with_priority(new_p, new_p->bound);
-        break;
-
-    default:
         error_no_mode_selected();
         return;
     }
 
+    state.policy->enqueue(new_p);
+
     state.np++; // Increase number of processes counter
+    job_process_added(new_p->job);
 }
 
 /*
- * Function:  run_basic
+ * Function:  no_foreground_jobs
  * --------------------
- * Executes basic policy (used by FCFS and SJF). Simply runs processes in the order they are in, in the waiting queue
+ * Run loop stop condition of run_scheduler
  */
-void run_basic()
+int no_foreground_jobs(int unused)
 {
-    exec_process();
+    return !foreground_jobs_running();
 }
 
 /*
- * Function:  run_RR
+ * Function:  stop_running
  * --------------------
- * Executes the Round Robin Policy. Runs current process for up to RR_PREEMPT_FREQ iterations and then places it at back of queue
+ * Adds the time since the current process started running to its run time
+ *
+ * long long now: current time (see monotonic_ns)
  */
-void run_RR()
+void stop_running(long long now)
 {
-    for (int i = 0; i < RR_PREEMPT_FREQ; ++i)
-    {
-        if (state.cur == NULL) // Process terminated in less than RR_PREEMPT_FREQ iterations
-            break;
-
-        exec_process();
-    }
+    if (state.running_since != -1)
+        state.cur->stats.run_ns += now - state.running_since;
+    state.running_since = -1;
+}
 
-    if (state.cur != NULL) // Check process isn't done
-    {
-        add_back(state.cur);
-        state.cur = NULL;
-    }
+/*
+ * Function:  process_exited
+ * --------------------
+ * Completes the accounting of the current process once it terminated (before it is freed)
+ *
+ * struct pcb *p: current process
+ */
+void process_exited(struct pcb *p)
+{
+    stop_running(monotonic_ns());
+    report_process_exit(p);
+    if (simulating)
+        simulated_exit(p);
 }
 
 /*
- * Function:  run_AGING
+ * Function:  run_policy
  * --------------------
- * Exectues the AGING Policy. Runs current process for 1 step, then decrements priority of waiting processes.
- * Then checks if new policy has higher priority and swaps if it does
+ * Runs the current policy's run loop. A process still running when it returns (e.g. out of budget while the prompt
+ * polls for input) is not charged for the time until the run loop resumes.
+ * Nested runs (e.g. wait executed by a background job) wait for external programs again unless they interleave too.
+ *
+ * int interleave: 1 if the prompt is waiting for input (see run_scheduler_for)
+ *
+ * returns (int): result of the run loop
  */
-void run_AGING()
+int run_policy(int budget, int (*stop)(int), int stop_arg, int interleave)
 {
-    exec_process();
-    decr_priorities();
+    int interleaving = state.interleaving;
 
-    if (state.cur != NULL && state.np > 1 && state.head != NULL && state.head->priority < state.cur_priority) // Current head of waiting queue has higher priority than current running process
-    {
-        add_with_priority(state.cur, state.cur_priority); // Add current running process back into priority queue (note that it will be added after the head element because of above check)
-        state.cur = NULL;
-    }
+    if (state.cur != NULL)
+        state.running_since = monotonic_ns();
+
+    state.interleaving = interleave;
+    int ret = state.policy->run(budget, stop, stop_arg);
+    state.interleaving = interleaving;
+
+    if (state.cur != NULL)
+        stop_running(monotonic_ns());
+    return ret;
 }
 
 /*
  * Function:  run_scheduler
  * --------------------
- * Runs the current selected scheduler policy on tasks in waiting queue
+ * Runs the current selected scheduler policy on tasks in waiting queue until every foreground job is done.
+ * Processes of background jobs share the queue, so they progress as well.
+ *
+ * returns (int): status (0 on success, 1 if no policy is selected)
  */
 int run_scheduler()
 {
-
-    while (state.np > 0)
+    // The run loop returns early when the policy changes, so keep going with the new one
+    while (state.np > 0 && foreground_jobs_running())
     {
-        if (state.cur == NULL) // No process is currently running
-            pop_front();       // Set head of waiting queue as running process
-
-        switch (state.mode)
+        if (state.policy == NULL)
         {
-        case FCFS:
-        case SJF:
-            run_basic();
-            break;
-        case RR:
-            run_RR();
-            break;
-        case AGING:
-            run_AGING();
-            break;
-        default:
             error_no_mode_selected();
             return 1;
         }
+        if (run_policy(INT_MAX, no_foreground_jobs, 0, 0) != 0)
+            break;
     }
     return 0;
 }
 
 /*
- * Function: exec_process
+ * Function:  run_scheduler_for
  * --------------------
- * Executes one instruction from the current running process
+ * Runs the current selected scheduler policy for a bounded number of instructions (used to interleave
+ * background jobs with the prompt)
+ *
+ * int budget: max number of instructions to execute
+ * int interleave: 1 if the prompt is waiting for input, so external programs of background jobs are left running
+ *                 rather than waited for (see external_may_suspend)
+ *
+ * returns (int): status (0 on success, 1 if no policy is selected)
  */
-void exec_process()
+int run_scheduler_for(int budget, int interleave)
 {
-    char *instr = read_instruction(state.cur);
+    if (!processes_waiting())
+        return 0;
 
-    if (instr == NULL)
+    if (state.policy == NULL)
     {
-        // Page fault occurred while reading instruction (read_instruction function handles loading page from backing store)
-        // place running process back into queue
-        switch (state.mode)
-        {
-        case FCFS:
-        case RR:
-            add_back(state.cur);
-            break;
+        error_no_mode_selected();
+        return 1;
+    }
 
-        case SJF:
-        case AGING:
-            add_with_priority(state.cur, state.cur_priority);
-            break;
+    run_policy(budget, NULL, 0, interleave);
+    return 0;
+}
 
-        default:
+/*
+ * Function:  run_scheduler_until_done
+ * --------------------
+ * Runs the scheduler until the given job is done
+ *
+ * int job: job to wait for (-1 to wait until every process has terminated)
+ *
+ * returns (int): status (0 on success, 1 if no policy is selected)
+ */
+int run_scheduler_until_done(int job)
+{
+    while (processes_waiting() && (job == -1 || !job_done(job)))
+    {
+        if (state.policy == NULL)
+        {
             error_no_mode_selected();
-            return;
+            return 1;
         }
+        if (run_policy(INT_MAX, job == -1 ? NULL : job_done, job, 0) != 0)
+            break;
+    }
+    return 0;
+}
 
-        state.cur = NULL;
-        return; // Return without executing anything
+/*
+ * Function: exec_instruction
+ * --------------------
+ * Executes one instruction from the current running process. Control statements (see build_flow) are executed
+ * here, by moving pc to the next line to run.
+ * An instruction whose external programs were left running blocks its process like a page fault (see
+ * suspend_current).
+ *
+ * returns (exec_result_t): outcome (instruction ran, page fault or suspended, or process terminated)
+ */
+exec_result_t exec_instruction()
+{
+    long long start = TIMING_START();
+    struct parsed_line *instr = read_instruction(state.cur);
+
+    if (instr == NULL)
+    {
+        // Page fault occurred while reading instruction, block the process until its page is loaded.
+        // It then returns to the queue where it was, so that it runs again before the page can be evicted by other
+        // faulting processes (sending it to the back livelocks once there are more processes than frames)
+        block_current();
+        return EXEC_FAULTED; // Return without executing anything
     }
 
+    state.cur->stats.instructions++;
+    SIM_CHARGE(instruction);
+
     // Update pointer and potentially remove process before executing instruction
     // This has better behaviour when the last instruction is itself a run/exec call
-    state.cur->pc++;
+    int job = state.cur->job;
+    p_t pid = state.cur->pid;
+    int finished = 0;
+    int control = state.cur->flow != NULL && state.cur->flow[state.cur->pc].kind != FLOW_NONE;
+    if (control)
+    {
+        int from = state.cur->pc;
+        state.cur->pc = run_control_line(state.cur, instr);
+        if (state.cur->pc <= from) // Back to the start of a loop
+            touch_loop_pages(state.cur, state.cur->pc / FRAMESIZE, from / FRAMESIZE);
+    }
+    else
+    {
+        state.cur->pc++;
+    }
+
     if (state.cur->pc >= state.cur->bound)
     {
+        TRACE_EVENT(TRACE_EXIT, state.cur->pid, state.cur->pc);
+        LOG_EVENT(LOG_EXIT, state.cur->pid, state.cur->pc);
+        process_exited(state.cur);
         free_process(state.cur);
         state.cur = NULL;
         state.np--;
+        finished = 1;
 
         if (state.np == 0)
         {
@@ -402,9 +985,29 @@ void exec_process()
         }
     }
 
-    run_on_buffered_line(instr, 0); // Run instruction line
+    int at = -1;
+    state.exec_job = job; // Processes launched by this instruction join its job
+    state.instr_ticks = 1;
+    if (!control && simulating)
+        simulate_parsed_line(instr); // Only its variables matter (see simulate)
+    else if (!control)
+        at = run_parsed_line(instr, 0); // Run instruction line (tokenized at page-in)
+    state.exec_job = -1;
 
-    free(instr);
+    if (at != -1)
+    {
+        // External programs left running, the rest of the line (and of the process) waits for them
+        suspend_current(instr, at, job, pid);
+        TIMING_END(PHASE_EXEC, start);
+        return finished ? EXEC_EXITED : EXEC_FAULTED;
+    }
+
+    // Only counted once the instruction ran, so the job can not be considered done while it launches more processes
+    if (finished)
+        job_process_finished(job);
 
-    return;
-}
\ No newline at end of file
+    release_line(instr);
+    TIMING_END(PHASE_EXEC, start);
+
+    return finished ? EXEC_EXITED : EXEC_RAN;
+}
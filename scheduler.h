@@ -2,18 +2,19 @@
 #define SCHEDULER_H
 #include "pcb.h"
 
-typedef enum // Possible scheduling policies
-{
-    FCFS,
-    SJF,
-    RR,
-    AGING,
-    NONE // Placeholder policy (used by run command)
-} sched_mode_t;
+struct sched_policy; // Scheduling policy (see policy.h)
 
 void add_process(struct pcb *new_p);
 void init_scheduler();
-int set_scheduler_mode(sched_mode_t new_mode);
+const struct sched_policy *find_policy(const char *name);
+int set_scheduler_policy(const struct sched_policy *new_policy);
 int run_scheduler();
+int run_scheduler_for(int budget, int interleave);
+int run_scheduler_until_done(int job);
 int processes_waiting();
-#endif
\ No newline at end of file
+int processes_runnable();
+int external_may_suspend();
+int current_job();
+void for_each_process(void (*visit)(struct pcb *p, void *arg), void *arg);
+void charge_external_time(long long ns);
+#endif
@@ -3,22 +3,38 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "interpreter.h"
 #include "shellmemory.h"
 #include "shell.h"
 #include "scheduler.h"
 #include "backing_store.h"
-
-#define MAX_INPUT_LEN 1000
-#define MAX_WORD_LEN 200
-#define MAX_WORDS 100
+#include "jobs.h"
+#include "tokenizer.h"
+#include "output.h"
+#include "replay.h"
+#include "spawn.h"
+
+#define INPUT_BUFFER_LEN 1000 // Initial size of the input line buffer (grows for longer lines)
+#define SCHED_POLL_INTERVAL 32 // Number of background instructions run between checks for pending input
+#define BATCH_COMMAND_FLAG "-c"  // mysh -c COMMANDS runs COMMANDS in batch mode
+#define RECORD_FLAG "--record"   // mysh --record LOG ... records scheduling and paging decisions to LOG
+#define REPLAY_FLAG "--replay"   // mysh --replay LOG ... runs again with the decisions recorded in LOG
+#define EXIT_USAGE 2             // Exit status of mysh when started with invalid arguments
+#define EXIT_NO_SCRIPT 127       // Exit status of mysh when the batch script can not be read
+#define EXIT_BAD_LOG 3           // Exit status of mysh when the decision log can not be opened
 
 int refresh_prompt = 1; // Indicates if the shell prompt ("$") should be printed again
 
 void handleErrorCode(int code);
-int readInput(char *words[MAX_WORDS], char *buffer, int *buff_pos);
 int main_loop();
+int run_batch(char *commands);
+void run_background_until_input();
+int input_pending(int fd, int wait);
 int error_invalid_frame_settings();
 
 /*
@@ -26,34 +42,166 @@ int error_invalid_frame_settings();
  * --------------------
  * Main Shell Function. Initializes Shell and starts main loop.
  *
- * returns (int): exit status
+ * Usage: mysh                 interactive shell (or reads commands from stdin, e.g. mysh < file)
+ *        mysh -c COMMANDS     runs COMMANDS (separated by ';' or newlines) in batch mode
+ *        mysh SCRIPT          runs the commands in SCRIPT in batch mode
+ * Any of them may be preceded by --record LOG (writes every scheduling and paging decision to LOG) or --replay LOG
+ * (runs with the decisions of LOG forced, given the same input, see replay.c).
+ *
+ * returns (int): exit status (in batch mode, the status of the last command)
  */
-int main()
+int main(int argc, char *argv[])
 {
+	char *batch = NULL; // Commands to run in batch mode (NULL for the interactive shell)
+	const char *program = argv[0];
+	const char *log_file = NULL;
+	log_mode_t mode = LOG_OFF;
+
+	init_output(); // Before anything is printed
+
 	// Check Macro values set correctly
 	if (FRAMESTORESIZE % FRAMESIZE != 0 || NFRAMES < 2)
 	{
 		return error_invalid_frame_settings();
 	}
 
-	printf("%s\n", "Shell version 3.0 \nCreated March, 2022 by Fynn Schmitt-Ulms");
-	printf("Frame Store Size = %d; Variable Store Size = %d\n\n", FRAMESTORESIZE, VARMEMSIZE);
-	help();
+	if (argc >= 2 && (strcmp(argv[1], RECORD_FLAG) == 0 || strcmp(argv[1], REPLAY_FLAG) == 0))
+	{
+		if (argc == 2)
+		{
+			fprintf(stderr, "Usage: %s [%s LOG | %s LOG] [-c COMMANDS | SCRIPT]\n", program, RECORD_FLAG, REPLAY_FLAG);
+			return EXIT_USAGE;
+		}
+		mode = strcmp(argv[1], RECORD_FLAG) == 0 ? LOG_RECORD : LOG_REPLAY;
+		log_file = argv[2];
+		argv += 2; // The rest is parsed as without the log
+		argc -= 2;
+	}
+
+	if (argc == 3 && strcmp(argv[1], BATCH_COMMAND_FLAG) == 0)
+	{
+		batch = strdup(argv[2]); // Tokenized in place
+	}
+	else if (argc == 2 && strcmp(argv[1], BATCH_COMMAND_FLAG) != 0)
+	{
+		batch = read_script(argv[1]);
+		if (batch == NULL)
+		{
+			perror(argv[1]);
+			return EXIT_NO_SCRIPT;
+		}
+	}
+	else if (argc != 1)
+	{
+		fprintf(stderr, "Usage: %s [%s LOG | %s LOG] [-c COMMANDS | SCRIPT]\n", program, RECORD_FLAG, REPLAY_FLAG);
+		return EXIT_USAGE;
+	}
+
+	if (log_file != NULL && log_open(log_file, mode) != 0)
+		return EXIT_BAD_LOG;
+
+	if (batch == NULL)
+	{
+		out_printf("%s\n", "Shell version 3.0 \nCreated March, 2022 by Fynn Schmitt-Ulms");
+		out_printf("Frame Store Size = %d; Variable Store Size = %d\n\n", FRAMESTORESIZE, VARMEMSIZE);
+		help();
+	}
 
 	// init shell memory
 	init_memory();
 	init_scheduler();
+	init_spawn();
 	init_backing_store();
+	if (init_commands() != 0)
+		return 1;
+
+	if (batch != NULL)
+		return run_batch(batch);
 
 	return main_loop();
 }
 
+/*
+ * Function:  read_script
+ * --------------------
+ * Reads a whole script into memory for batch mode and source (one read, no per-line I/O)
+ *
+ * const char *filename: script to read
+ *
+ * returns (char *): malloc'd, NUL terminated contents of the script, NULL on error (errno is set)
+ */
+char *read_script(const char *filename)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1)
+		return NULL;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	size_t cap = st.st_size > 0 ? st.st_size + 1 : 4096; // Size may be unknown (e.g. a pipe), grow if needed
+	size_t len = 0;
+	char *contents = malloc(cap);
+	ssize_t n = 0;
+
+	while (contents != NULL && (n = read(fd, contents + len, cap - len - 1)) > 0)
+	{
+		len += n;
+		if (len + 1 == cap)
+		{
+			char *grown = realloc(contents, 2 * cap);
+			if (grown == NULL)
+			{
+				free(contents);
+				contents = NULL;
+				break;
+			}
+			contents = grown;
+			cap *= 2;
+		}
+	}
+	close(fd);
+
+	if (contents == NULL || n == -1)
+	{
+		free(contents);
+		return NULL;
+	}
+
+	contents[len] = '\0';
+	return contents;
+}
+
+/*
+ * Function:  run_batch
+ * --------------------
+ * Batch mode: runs every command of the given input, then lets remaining processes (including background jobs) finish
+ * and exits. Nothing is printed besides the output of the commands.
+ *
+ * char *commands: commands to run (separated by ';' or newlines, modified in place and freed)
+ *
+ * returns (int): exit status (status of the last command)
+ */
+int run_batch(char *commands)
+{
+	int status = run_on_buffered_line(commands, 1); // Runs each line like the main loop would
+	run_scheduler_until_done(-1);
+
+	free(commands);
+	clear_backing_store();
+	return status;
+}
+
 /*
  * Function:  main_loop
  * --------------------
  * Contains the main loop for the shell. Repeatedly reads lines into buffer and call run_on_buffered_line function.
- * Note that before executing the current line it first checks if there are processes waiting to be run, and starts the
- * scheduler if needed.
+ * Note that before executing the current line it first checks if there are foreground jobs waiting to be run, and
+ * starts the scheduler if needed. Background jobs are run while the shell waits for the next line of input.
  *
  * returns (int): exit status
  */
@@ -61,8 +209,9 @@ int main_loop()
 {
 	char shell_prompt = '$';
 	char *buffer;
-	size_t buffer_size = MAX_INPUT_LEN;
+	size_t buffer_size = INPUT_BUFFER_LEN; // Lines of any length are read, getline grows the buffer as needed
 	int n_read = 0;
+	int interactive = isatty(fileno(stdin)); // Checked once (and again when input switches to the terminal)
 
 	buffer = (char *)malloc(buffer_size * sizeof(char));
 	if (buffer == NULL)
@@ -71,11 +220,14 @@ int main_loop()
 		exit(1);
 	}
 
-	while (1)
+	if (interactive)
 	{
-		buffer_size = MAX_INPUT_LEN;
+		setvbuf(stdin, NULL, _IONBF, 0); // Don't read ahead of the current line, so polling stdin reflects pending input
+	}
 
-		if (processes_waiting())
+	while (1)
+	{
+		if (foreground_jobs_running())
 		{
 			run_scheduler(); // Run/Exec functions do not start the scheduler, but instead only add the scheduled tasks to
 			// the waiting queue. The tasks are then started on the next iteration of the main loop (here).
@@ -83,16 +235,32 @@ int main_loop()
 			// Instaed there is only at most one run_scheduler call executing at a time (preventing stackoverflow exceptions from over recursing)
 			continue;
 		}
-		if (isatty(fileno(stdin)))
+		if (interactive)
 		{
-			printf("%c ", shell_prompt); // print prompt only if the shell is not being run from a file
+			report_finished_jobs();
+			out_printf("%c ", shell_prompt); // print prompt only if the shell is not being run from a file
+			out_flush();
 		}
 
+		run_background_until_input(); // Background jobs make progress until the next line is available
+
 		n_read = getline(&buffer, &buffer_size, stdin); // Read line of input
 
 		if (n_read == -1)
 		{
-			freopen("/dev/tty", "rw", stdin); // If running from a file (i.e. mysh < file) and the file has ended, switch to user shell input
+			run_scheduler_until_done(-1); // Input ended, let background jobs finish
+
+			// If running from a file (i.e. mysh < file) and the file has ended, switch to user shell input.
+			// Without a terminal (e.g. started by a job runner) there is no more input, so exit instead of spinning on EOF
+			if (freopen("/dev/tty", "r", stdin) == NULL)
+			{
+				free(buffer);
+				clear_backing_store();
+				return 0;
+			}
+			interactive = isatty(fileno(stdin));
+			if (interactive)
+				setvbuf(stdin, NULL, _IONBF, 0);
 			continue;
 		}
 
@@ -102,6 +270,49 @@ int main_loop()
 	return 0;
 }
 
+/*
+ * Function:  run_background_until_input
+ * --------------------
+ * Runs the scheduler on background jobs until input is available on stdin (or there is nothing left to run).
+ * Stdin is polled every SCHED_POLL_INTERVAL instructions so the prompt stays responsive. External programs of
+ * background jobs are not waited for (see run_external): when only they are left, the shell waits for input or for
+ * one of them to exit, whichever comes first.
+ */
+void run_background_until_input()
+{
+	while (processes_waiting())
+	{
+		if (run_scheduler_for(SCHED_POLL_INTERVAL, 1) != 0)
+			return;
+
+		// Input (or EOF/error) pending. How far background jobs get depends on timing, so it is a logged decision
+		if (!LOG_FORCE(LOG_CONTINUE, 0, !input_pending(fileno(stdin), !processes_runnable())))
+			return;
+	}
+}
+
+/*
+ * Function:  input_pending
+ * --------------------
+ * Checks for input on fd
+ *
+ * int fd: input to check
+ * int wait: 1 to wait until there is input or an external program exited (see wait_input_or_exit)
+ *
+ * returns (int): Indicator (1 if input (or EOF/error) is pending, 0 otherwise)
+ */
+int input_pending(int fd, int wait)
+{
+	struct pollfd pfd = {fd, POLLIN, 0};
+	int ready;
+
+	if (wait)
+		return wait_input_or_exit(fd);
+	while ((ready = poll(&pfd, 1, 0)) == -1 && errno == EINTR)
+		; // Interrupted by an exiting program
+	return ready != 0;
+}
+
 /*
  * Function:  error_invalid_frame_settings
  * -------------------------------------------
@@ -111,7 +322,7 @@ int main_loop()
  */
 int error_invalid_frame_settings()
 {
-	printf("Invalid Frame size or Frame store size. Frame store must be a multiple of Frame size and must be large enough to contain at least 2 frames\n\n");
+	out_printf("Invalid Frame size or Frame store size. Frame store must be a multiple of Frame size and must be large enough to contain at least 2 frames\n\n");
 	return -2;
 }
 
@@ -120,106 +331,87 @@ int error_invalid_frame_settings()
  * -------------------------------------------
  * Contains another loop that reads the next command (to handle multi-command lines)
  *
- * char *buffer: buffered line of input to use
+ * char *buffer: buffered line of input to use (words are terminated in place, see next_command)
  * int in_main_loop: indicator flag (should be 1 if called from main_loop, 0 otherwise)
  *
+ * returns (int): status of the last command (0 if the line has no command)
  */
-void run_on_buffered_line(char *buffer, int in_main_loop)
+int run_on_buffered_line(char *buffer, int in_main_loop)
 {
-	int w;
-	char *words[MAX_WORDS];
-	int code;
+	struct token_list tokens; // Words are slices of buffer, nothing is allocated for typical commands
+	int code = 0;
 	int buff_pos = 0;
 
+	init_tokens(&tokens);
+	if (in_main_loop)
+		LOG_EVENT(LOG_INPUT, 0, log_checksum(LOG_CHECKSUM_INIT, buffer, strlen(buffer)));
+
 	while (1)
 	{
 		if (in_main_loop) // Only executes if called with input from the main shell loop (and not from running process)
 		{
-			if (processes_waiting())
+			if (foreground_jobs_running())
 			{
 				run_scheduler();
 				continue;
 			}
 		}
 		// Read words for next command (if multiple commands in one line, only reads args for first)
-		w = readInput(words, buffer, &buff_pos);
-
-		if (w == -1)
+		if (next_command(buffer, &buff_pos, &tokens) == -1)
 		{
 			// Reached end of buffered line
-			return;
+			free_tokens(&tokens);
+			return code;
 		}
 
 		// Execute command
-		code = interpreter(words, w);
-
-		// Free stored words
-		while (w--)
-			free(words[w]);
+		code = interpreter(tokens.words, tokens.n);
 
 		handleErrorCode(code);
 	}
-
-	return;
 }
 
 /*
- * Function:  readInput
- * --------------------
- * Improved input parsing fucntion that can handle extra tabs and spaces between input words
- * Reads in words from buffer and stores pointers to them in words.
- * Will read up until '\n', or ';'
+ * Function:  run_parsed_line
+ * -------------------------------------------
+ * Runs every command of a pre-tokenized script line (see parse_line). Unlike run_on_buffered_line, the line is not
+ * parsed again, and it is left unchanged so it can be run again.
+ * Stops at a command whose external programs were left running (see run_external), the scheduler runs the rest of
+ * the line once they exited.
  *
- * char *words[MAX_WORDS]: Array of words pointers to fill. words[i] will point to a copy of the i-th entered word when function returns
- * char *buffer: a buffer to read from
- * int *buff_pos: current position in buffer to read at
+ * struct parsed_line *line: line to run
+ * int first_cmd: index of the first command to run (0 for the whole line)
  *
- * returns (int): Number of words read (or -1 if in_stream is empty)
+ * returns (int): index of the suspended command, -1 if the whole line ran
  */
-int readInput(char *words[MAX_WORDS], char *buffer, int *buff_pos)
+int run_parsed_line(struct parsed_line *line, int first_cmd)
 {
-	int w = 0;
-	char tmp[MAX_WORD_LEN];
-	char *tmpi = tmp;
-	char *end = tmp + MAX_WORD_LEN - 1;
-	char c;
-
-	// Indicate the end of the buffer has been reached
-	if ((c = buffer[*buff_pos]) == '\0')
+	for (int i = first_cmd; i < line->n_cmds; i++)
 	{
-		return -1;
+		struct parsed_command *cmd = &line->cmds[i];
+		int code = run_parsed_command(line, cmd);
+		if (code == EXTERNAL_SUSPENDED)
+			return i;
+		handleErrorCode(code);
 	}
+	return -1;
+}
 
-	// Ignore leading whitespace
-	while (c == ' ' || c == '\t')
-		c = buffer[++*buff_pos];
-
-	// Each iter reads a word
-	do
-	{
-		while (c != '\0' && c != ' ' && c != '\n' && c != ';' && tmpi < end)
-		{
-			// Each iter reads a char of a word
-			*tmpi++ = c;
-			c = buffer[++*buff_pos];
-		}
-		*tmpi = '\0';
-
-		words[w++] = strdup(tmp); // Duplicate word in tmp and set word pointer
-		tmpi = tmp;				  // Reset tmpi to point to the start of the tmp array
-
-		// Ignore trailing whitespace (between words/after last word)
-		while (c == ' ' || c == '\t')
-			c = buffer[++*buff_pos];
-
-	} while (c != '\0' && c != '\n' && c != ';');
-
-	if (c != '\0')
+/*
+ * Function:  simulate_parsed_line
+ * -------------------------------------------
+ * Runs only the commands of a pre-tokenized script line that set variables, which control statements may depend on
+ * (see simulate). No program or process is started.
+ *
+ * struct parsed_line *line: line to run
+ */
+void simulate_parsed_line(struct parsed_line *line)
+{
+	for (int i = 0; i < line->n_cmds; i++)
 	{
-		++*buff_pos;
+		if (line->cmds[i].op == OP_SET)
+			handleErrorCode(run_parsed_command(line, &line->cmds[i]));
 	}
-
-	return w;
 }
 
 /*
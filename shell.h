@@ -2,6 +2,10 @@
 #define SHELL_H
 #include <stdio.h>
 
-void run_on_buffered_line(char *buffer, int in_main_loop);
+int run_on_buffered_line(char *buffer, int in_main_loop);
+char *read_script(const char *filename);
+struct parsed_line;
+int run_parsed_line(struct parsed_line *line, int first_cmd);
+void simulate_parsed_line(struct parsed_line *line);
 
 #endif
\ No newline at end of file
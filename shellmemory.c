@@ -4,6 +4,14 @@
 #include "shellmemory.h"
 #include "pcb.h"
 #include "backing_store.h"
+#include "interpreter.h"
+#include "output.h"
+#include "trace.h"
+#include "clock.h"
+#include "scheduler.h"
+
+#define MEMSTAT_JSON "json"   // memstat argument selecting the machine-readable format
+#define MEMSTAT_RESET "reset" // memstat argument starting a new interval
 
 // Variables defined in makefile
 // FRAMESTORESIZE, FRAMESIZE, VARMEMSIZE, NFRAMES, SHELLMEMSIZE
@@ -12,6 +20,13 @@ struct memory_struct // Elements that the shellmemory is comprised of
 {
 	char *var;
 	char *value;
+	struct parsed_line *line; // Pre-tokenized form of value (frame store only, built at page-in)
+};
+
+struct frame_owner // Page held by a frame, compared on every instruction read (see page_resident)
+{
+	p_t pid;	 // Process the page belongs to
+	int pagenum; // Page number in the process (-1 if the frame holds no page)
 };
 
 struct lru_ll // least recently used double linked list definition
@@ -28,11 +43,39 @@ struct memory_state // struct containing all important shellmemory state
 	struct lru_ll *head, *tail;						// head and tail of LRU double linked list
 	struct memory_struct shellmemory[SHELLMEMSIZE]; // Shellmemory array (note that SHELLMEMSIZE = VARMEMSIZE + FRAMESTORESIZE)
 	struct lru_ll *ll_quick[NFRAMES];				// Arrary of pointers to elements in LRU linked list, allows O(1) access to any frame
+	struct frame_owner owners[NFRAMES];				// Page held by each frame (the frame key in shellmemory names it for printing)
+	unsigned int var_generation;					// Incremented whenever variables may move to other slots (see mem_var_generation)
 } m_state;											// Note that m_state is an instance of the above struct
 
+struct saved_vars // Variables moved out of the variable store (see mem_save_vars)
+{
+	int n;						// Number of slots
+	struct memory_struct *vars; // Slots in order, variables keep their slot when restored
+};
+
+struct memory_stats // Counters reported by memstat, since the shell started or the last "memstat reset"
+{
+	unsigned long long hits;			 // Instructions read from a resident page
+	unsigned long long faults;			 // Instruction reads that found their page not resident
+	unsigned long long page_ins;		 // Pages loaded from the backing store
+	unsigned long long evictions;		 // Pages evicted to make room for another page
+	unsigned long long var_set_failures; // Variables that could not be set because the variable store was full
+	long long since;					 // Start of the interval (ns, monotonic clock)
+} m_stats;
+
+struct process_residency // Resident pages of the live processes, gathered for memstat (see count_resident)
+{
+	int json;		 // Indicator (1 to print as JSON array elements)
+	int n;			 // Number of processes printed
+	int resident;	 // Total resident pages of live processes
+};
+
 int get_frame_start(int framenum);
+void read_victim_text(struct pcb *p, void *arg);
 char *create_frame_key(p_t pid, int pagenum);
 void mem_full_error();
+void count_resident(struct pcb *p, void *arg);
+int free_frames();
 
 /*
  * Function:  move_to_back
@@ -122,6 +165,9 @@ void init_memory()
 {
 	m_state.cur_var_size = 0;
 	m_state.frames_allocated = 0;
+	m_state.var_generation = 0;
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_stats.since = monotonic_ns();
 
 	// Build LRU linked list queue
 	struct lru_ll *prev;
@@ -134,6 +180,7 @@ void init_memory()
 		}
 		new_frame->framenum = i;
 		m_state.ll_quick[i] = new_frame;
+		m_state.owners[i].pagenum = -1;
 
 		if (i == 0)
 		{
@@ -154,6 +201,7 @@ void init_memory()
 	{
 		m_state.shellmemory[i].var = NULL;
 		m_state.shellmemory[i].value = NULL;
+		m_state.shellmemory[i].line = NULL;
 	}
 }
 
@@ -179,9 +227,13 @@ void mem_reset_frames()
 		{
 			free(m_state.shellmemory[i].value);
 		}
+		release_line(m_state.shellmemory[i].line); // Freed once no running instruction holds it
 		m_state.shellmemory[i].var = NULL;
 		m_state.shellmemory[i].value = NULL;
+		m_state.shellmemory[i].line = NULL;
 	}
+	for (int i = 0; i < NFRAMES; i++)
+		m_state.owners[i].pagenum = -1;
 	m_state.frames_allocated = 0;
 }
 
@@ -204,15 +256,14 @@ void remove_process_claims(struct pcb *pcb)
 		if (framenumber == -1)
 			continue;
 
-		char *key = create_frame_key(pcb->pid, i);
-		int frame_start = get_frame_start(framenumber);
-		if (m_state.shellmemory[frame_start].var != NULL && strcmp(m_state.shellmemory[frame_start].var, key) == 0)
+		if (page_resident(pcb, i))
 		{
+			int frame_start = get_frame_start(framenumber);
 			free(m_state.shellmemory[frame_start].var);
 			m_state.shellmemory[frame_start].var = NULL;
+			m_state.owners[framenumber].pagenum = -1;
 			move_to_front(framenumber);
 		}
-		free(key);
 	}
 }
 
@@ -234,7 +285,7 @@ int get_frame_start(int framenum)
  * Function:  create_frame_key
  * --------------------
  * Creates a string key which indicates the running process and page number
- * being stored in a frame
+ * being stored in a frame (only marks the frame as used, residency checks compare frame owners)
  *
  * p_t pid: process id
  * int pagenum: page number to store
@@ -252,7 +303,8 @@ char *create_frame_key(p_t pid, int pagenum)
 /*
  * Function:  check_eviction
  * --------------------
- * Checks if a frame is currently allocated. If it is, evicts the frame
+ * Checks if a frame is currently allocated. If it is, evicts the frame (the victim page is printed if the victim
+ * page sink is on, see trace_victims)
  *
  * int framenum: frame to check
  *
@@ -266,28 +318,44 @@ void check_eviction(int framenum)
 		// No Eviction
 		return;
 	}
+	m_stats.evictions++;
 
-	printf("%s\n", "Page fault! Victim page contents:");
+	if (tracing)
+		trace_event(TRACE_EVICT, m_state.owners[framenum].pid, m_state.owners[framenum].pagenum);
+
+	int print = trace_victims();
+	if (print)
+	{
+		if (m_state.shellmemory[start].value == NULL)
+			for_each_process(read_victim_text, &framenum); // Page was loaded before victim pages were printed
+		out_printf("%s\n", "Page fault! Victim page contents:");
+	}
 
 	for (int i = 0; i < FRAMESIZE; i++)
 	{
 		if (m_state.shellmemory[start + i].value != NULL)
 		{
-			printf("%s", m_state.shellmemory[start + i].value);
+			if (print)
+				out_puts(m_state.shellmemory[start + i].value);
 			free(m_state.shellmemory[start + i].value);
 			m_state.shellmemory[start + i].value = NULL;
 		}
+		release_line(m_state.shellmemory[start + i].line);
+		m_state.shellmemory[start + i].line = NULL;
 	}
 
-	printf("%s\n", "End of victim page contents.");
+	if (print)
+		out_printf("%s\n", "End of victim page contents.");
 	free(m_state.shellmemory[start].var);
 	m_state.shellmemory[start].var = NULL;
+	m_state.owners[framenum].pagenum = -1;
 }
 
 /*
  * Function:  load_from_backing_store
  * --------------------
- * Loads a page from backing store into LRU frame.
+ * Loads a page from backing store into LRU frame. The frame gets the compiled lines of the page, and their text
+ * only while victim pages are printed (see trace_victims).
  *
  * struct pcb *pcb: pcb of process to load from
  * int start_line: line to start loading from (loads lines start_line:start_line+FRAMESIZE)
@@ -300,19 +368,36 @@ int load_from_backing_store(struct pcb *pcb, int start_line)
 {
 	char **frame_refs[FRAMESIZE];
 
+	m_stats.page_ins++;
 	int framenum = get_next_frame();
 	check_eviction(framenum);
 	int start = get_frame_start(framenum);
-	for (int i = 0; i < FRAMESIZE; ++i)
-	{
-		frame_refs[i] = &(m_state.shellmemory[start + i].value); // Get references to shellmemory location so that backing store can copy directly into memory
-	}
 
 	// Note: only update shellmemory key for first block in frame (unnecessary to update others)
 	int pagenum = start_line / FRAMESIZE;
 	m_state.shellmemory[start].var = create_frame_key(pcb->pid, pagenum);
+	m_state.owners[framenum].pid = pcb->pid;
+	m_state.owners[framenum].pagenum = pagenum;
 
-	load_into_mem(pcb, start_line, frame_refs);
+	// Lines were compiled when the script was copied (see cp_to_store), frames only hold references to them
+	for (int i = 0; i < FRAMESIZE; ++i)
+	{
+		struct memory_struct *slot = &m_state.shellmemory[start + i];
+		release_line(slot->line);
+		slot->line = start_line + i < pcb->bound ? pcb->lines[start_line + i] : NULL;
+		if (slot->line != NULL)
+			hold_line(slot->line);
+	}
+
+	// The text of the page is only read if it is printed when evicted (simulated processes have no copy to read)
+	if (trace_victims() && pcb->page_offsets != NULL)
+	{
+		for (int i = 0; i < FRAMESIZE; ++i)
+		{
+			frame_refs[i] = &(m_state.shellmemory[start + i].value); // Get references to shellmemory location so that backing store can copy directly into memory
+		}
+		load_into_mem(pcb, start_line, frame_refs);
+	}
 
 	m_state.frames_allocated = 1;
 
@@ -342,46 +427,131 @@ void clear_shell_mem()
 	}
 
 	m_state.cur_var_size = 0;
+	m_state.var_generation++; // Slots found before the reset are stale
 }
 
 /*
- * Function:  read_instruction
+ * Function:  mem_save_vars
  * --------------------
- * Attempts to read the next instruction (line) for the given process.
- * Detects and handles page faults
+ * Moves every defined variable out of the variable store, leaving it empty (like clear_shell_mem). The variables are
+ * put back by mem_restore_vars, so a command can use the store without losing the user's variables.
  *
- * struct pcb *pcb: pcb of process.
+ * returns (struct saved_vars *): saved variables, NULL if they could not be saved (the store is then unchanged)
+ */
+struct saved_vars *mem_save_vars()
+{
+	struct saved_vars *saved = malloc(sizeof(struct saved_vars));
+	if (saved == NULL)
+		return NULL;
+	saved->n = m_state.cur_var_size;
+	saved->vars = malloc((saved->n > 0 ? saved->n : 1) * sizeof(struct memory_struct));
+	if (saved->vars == NULL)
+	{
+		free(saved);
+		return NULL;
+	}
+
+	memcpy(saved->vars, m_state.shellmemory, saved->n * sizeof(struct memory_struct));
+	for (int i = 0; i < saved->n; i++)
+	{
+		m_state.shellmemory[i].var = NULL;
+		m_state.shellmemory[i].value = NULL;
+	}
+	m_state.cur_var_size = 0;
+	m_state.var_generation++; // Slots found before are stale
+	return saved;
+}
+
+/*
+ * Function:  mem_restore_vars
+ * --------------------
+ * Replaces the variable store with variables saved by mem_save_vars (variables defined since are cleared)
  *
- * returns (char *): Returns pointer to copy of instruction (should be freed) or NULL on page fault.
+ * struct saved_vars *saved: saved variables (freed)
  */
-char *read_instruction(struct pcb *pcb)
+void mem_restore_vars(struct saved_vars *saved)
+{
+	clear_shell_mem();
+	memcpy(m_state.shellmemory, saved->vars, saved->n * sizeof(struct memory_struct));
+	m_state.cur_var_size = saved->n;
+	m_state.var_generation++;
+	free(saved->vars);
+	free(saved);
+}
+
+/*
+ * Function:  page_resident
+ * --------------------
+ * Checks if a page of the given process is currently loaded in frame memory
+ *
+ * struct pcb *pcb: pcb of process
+ * int pagenum: page to check
+ *
+ * returns (int): Indicator (1 if the page is resident, 0 otherwise)
+ */
+int page_resident(struct pcb *pcb, int pagenum)
 {
-	int pagenum = pcb->pc / FRAMESIZE;
-	int offset = pcb->pc % FRAMESIZE;
 	int framenumber = pcb->pagetable[pagenum];
 	if (framenumber == -1)
+		return 0;
+
+	struct frame_owner *owner = &m_state.owners[framenumber];
+	return owner->pagenum == pagenum && owner->pid == pcb->pid;
+}
+
+/*
+ * Function:  touch_loop_pages
+ * --------------------
+ * Updates the LRU list after a process jumped back to the start of a loop: the resident pages of the loop body will
+ * be used again, the first one soonest, so they become the most recently used pages in that order. Pages of other
+ * processes (or of code this process already ran past) are then evicted before the loop body, and a loop larger
+ * than the frame store evicts its own last pages first instead of the page needed next.
+ *
+ * struct pcb *pcb: pcb of process
+ * int first_page: page of the loop header
+ * int last_page: page of the end of the loop
+ */
+void touch_loop_pages(struct pcb *pcb, int first_page, int last_page)
+{
+	for (int page = last_page; page >= first_page; page--)
 	{
-		load_page(pcb, pagenum); // page fault
-		return NULL;
+		if (page_resident(pcb, page))
+			move_to_back(pcb->pagetable[page]);
 	}
+}
 
-	char *key = create_frame_key(pcb->pid, pagenum);
+/*
+ * Function:  read_instruction
+ * --------------------
+ * Attempts to read the next instruction (line) for the given process.
+ * Detects page faults. The faulting page is not loaded here, the scheduler queues the page-in (see block_current)
+ *
+ * struct pcb *pcb: pcb of process.
+ *
+ * returns (struct parsed_line *): Returns the pre-tokenized instruction, held for the caller (should be released
+ *                                 with release_line), or NULL on page fault.
+ */
+struct parsed_line *read_instruction(struct pcb *pcb)
+{
+	int pagenum = pcb->pc / FRAMESIZE;
+	int offset = pcb->pc % FRAMESIZE;
 
-	int frame_start = get_frame_start(framenumber);
-	if (m_state.shellmemory[frame_start].var == NULL || strcmp(m_state.shellmemory[frame_start].var, key) != 0)
+	if (!page_resident(pcb, pagenum))
 	{
-		// Frame not allocated to current process
-		load_page(pcb, pagenum); // page fault
-		free(key);
-		return NULL;
+		m_stats.faults++;
+		return NULL; // page fault
 	}
+	m_stats.hits++;
 
-	free(key);
+	int framenumber = pcb->pagetable[pagenum];
+	int frame_start = get_frame_start(framenumber);
 
 	// Update LRU
 	move_to_back(framenumber);
 
-	return strdup(m_state.shellmemory[frame_start + offset].value);
+	struct parsed_line *line = m_state.shellmemory[frame_start + offset].line;
+	hold_line(line); // The frame may be evicted or reset while the instruction runs
+	return line;
 }
 
 /*
@@ -429,7 +599,8 @@ void mem_set_value(char *var_in, char *value_in)
  */
 void mem_full_error()
 {
-	printf("Error: Shell Memory Full, can't set Environment Variable.\n");
+	m_stats.var_set_failures++;
+	out_printf("Error: Shell Memory Full, can't set Environment Variable.\n");
 }
 
 /*
@@ -455,4 +626,187 @@ char *mem_get_value(char *var_in)
 		}
 	}
 	return NULL;
-}
\ No newline at end of file
+}
+
+/*
+ * Function:  mem_find_var
+ * --------------------
+ * Finds the variable store slot of a variable. A variable keeps its slot until the variable store is cleared, so
+ * callers may cache slots as long as mem_var_generation is unchanged.
+ *
+ * const char *var_in: name of variable
+ *
+ * returns (int): slot of variable, -1 if the variable is not defined
+ */
+int mem_find_var(const char *var_in)
+{
+	for (int i = 0; i < m_state.cur_var_size; i++)
+	{
+		if (m_state.shellmemory[i].var && strcmp(m_state.shellmemory[i].var, var_in) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Function:  mem_var_generation
+ * --------------------
+ * returns (unsigned int): generation of the variable store, slots found by mem_find_var are valid while it is unchanged
+ */
+unsigned int mem_var_generation()
+{
+	return m_state.var_generation;
+}
+
+/*
+ * Function:  mem_var_value
+ * --------------------
+ * returns (char *): value of the variable in the given slot (not a copy, only valid until the variable is set again)
+ */
+char *mem_var_value(int slot)
+{
+	return m_state.shellmemory[slot].value;
+}
+
+/*
+ * Function:  mem_set_var_value
+ * --------------------
+ * Replaces the value of the variable in the given slot (see mem_find_var)
+ */
+void mem_set_var_value(int slot, const char *value_in)
+{
+	free(m_state.shellmemory[slot].value);
+	m_state.shellmemory[slot].value = strdup(value_in);
+}
+
+/*
+ * Function:  free_frames
+ * --------------------
+ * returns (int): number of frames holding no page
+ */
+int free_frames()
+{
+	int n = 0;
+	for (int i = 0; i < NFRAMES; i++)
+	{
+		if (m_state.shellmemory[get_frame_start(i)].var == NULL)
+			n++;
+	}
+	return n;
+}
+
+/*
+ * Function:  read_victim_text
+ * --------------------
+ * Reads the text of a page being evicted from the backing store, if it belongs to the process (for_each_process
+ * visitor used by check_eviction, pages are loaded without their text while victim pages are not printed)
+ *
+ * struct pcb *p: live process
+ * void *arg: frame being evicted (int)
+ */
+void read_victim_text(struct pcb *p, void *arg)
+{
+	int framenum = *(int *)arg;
+	int start = get_frame_start(framenum);
+	char **frame_refs[FRAMESIZE];
+
+	if (p->pid != m_state.owners[framenum].pid || p->page_offsets == NULL || m_state.shellmemory[start].value != NULL)
+		return;
+
+	for (int i = 0; i < FRAMESIZE; ++i)
+		frame_refs[i] = &(m_state.shellmemory[start + i].value);
+	load_into_mem(p, m_state.owners[framenum].pagenum * FRAMESIZE, frame_refs);
+}
+
+/*
+ * Function:  count_resident
+ * --------------------
+ * Prints the resident pages of a live process (for_each_process visitor used by memstat)
+ *
+ * struct pcb *p: live process
+ * void *arg: struct process_residency being gathered
+ */
+void count_resident(struct pcb *p, void *arg)
+{
+	struct process_residency *r = arg;
+	int n_pages = (p->bound + FRAMESIZE - 1) / FRAMESIZE;
+	int resident = 0;
+
+	if (p->materialized)
+	{
+		for (int page = 0; page < n_pages; page++)
+			resident += page_resident(p, page);
+	}
+	r->resident += resident;
+
+	if (r->json)
+		out_printf("%s{\"pid\":%llu,\"resident_pages\":%d,\"pages\":%d}", r->n > 0 ? "," : "", p->pid, resident, n_pages);
+	else
+		out_printf("  %-8llu %-10d %-8d %s\n", p->pid, resident, n_pages, p->script);
+	r->n++;
+}
+
+/*
+ * Function:  memstat
+ * --------------------
+ * memstat builtin: reports the health of the frame store and the variable store over the current interval
+ * (since the shell started or the last "memstat reset"): instruction hit rate, faults, page-ins, evictions, free
+ * frames, resident pages of each live process and variable store occupancy.
+ *   memstat          human readable report
+ *   memstat json     report as a single line JSON object
+ *   memstat reset    starts a new interval
+ *
+ * char *args[]: arguments (without the command name)
+ * int n_args: number of arguments
+ *
+ * returns (int): status
+ */
+int memstat(char *args[], int n_args)
+{
+	int json = n_args == 1 && strcmp(args[0], MEMSTAT_JSON) == 0;
+
+	if (n_args == 1 && strcmp(args[0], MEMSTAT_RESET) == 0)
+	{
+		long long now = monotonic_ns();
+		memset(&m_stats, 0, sizeof(m_stats));
+		m_stats.since = now;
+		return 0;
+	}
+	if (n_args == 1 && !json)
+	{
+		out_printf("%s\n", "Bad command: Expected memstat [json|reset]");
+		return 17;
+	}
+
+	double seconds = (monotonic_ns() - m_stats.since) / 1e9;
+	unsigned long long reads = m_stats.hits + m_stats.faults;
+	double hit_rate = reads > 0 ? (double)m_stats.hits / reads : 0;
+	double faults_per_s = seconds > 0 ? m_stats.faults / seconds : 0;
+	int n_free = free_frames();
+	struct process_residency r = {json, 0, 0};
+
+	if (json)
+	{
+		out_printf("{\"interval_s\":%.6f,\"reads\":%llu,\"hits\":%llu,\"faults\":%llu,\"hit_rate\":%.6f,"
+				   "\"faults_per_s\":%.3f,\"page_ins\":%llu,\"evictions\":%llu,\"frames\":%d,\"frame_lines\":%d,"
+				   "\"free_frames\":%d,\"var_slots\":%d,\"vars_used\":%d,\"var_set_failures\":%llu,\"processes\":[",
+				   seconds, reads, m_stats.hits, m_stats.faults, hit_rate, faults_per_s, m_stats.page_ins,
+				   m_stats.evictions, NFRAMES, FRAMESIZE, n_free, VARMEMSIZE, m_state.cur_var_size,
+				   m_stats.var_set_failures);
+		for_each_process(count_resident, &r);
+		out_printf("],\"stale_frames\":%d}\n", NFRAMES - n_free - r.resident);
+		return 0;
+	}
+
+	out_printf("Interval: %.3f s\n", seconds);
+	out_printf("Instruction reads: %llu, hit rate %.2f%%, %llu faults (%.1f/s)\n", reads, 100 * hit_rate, m_stats.faults,
+			   faults_per_s);
+	out_printf("Page-ins: %llu, evictions: %llu\n", m_stats.page_ins, m_stats.evictions);
+	out_printf("Variable store: %d/%d slots used, %llu failed sets\n", m_state.cur_var_size, VARMEMSIZE,
+			   m_stats.var_set_failures);
+	out_printf("Resident pages:\n  %-8s %-10s %-8s %s\n", "PID", "RESIDENT", "PAGES", "SCRIPT");
+	for_each_process(count_resident, &r);
+	out_printf("Frame store: %d frames of %d lines, %d free, %d held by terminated processes\n", NFRAMES, FRAMESIZE,
+			   n_free, NFRAMES - n_free - r.resident);
+	return 0;
+}
@@ -3,13 +3,25 @@
 
 #include "pcb.h"
 
+struct parsed_line;
+struct saved_vars; // Variables saved by mem_save_vars (shellmemory.c)
+
 void init_memory();
 char *mem_get_value(char *var);
 void mem_set_value(char *var, char *value);
-char *read_instruction(struct pcb *p);
+int mem_find_var(const char *var);
+unsigned int mem_var_generation();
+char *mem_var_value(int slot);
+void mem_set_var_value(int slot, const char *value);
+struct parsed_line *read_instruction(struct pcb *p);
+int page_resident(struct pcb *pcb, int pagenum);
+void touch_loop_pages(struct pcb *pcb, int first_page, int last_page);
 int load_from_backing_store(struct pcb *pcb, int start_line);
 void remove_process_claims(struct pcb *pcb);
 void mem_reset_frames();
 void clear_shell_mem();
+struct saved_vars *mem_save_vars();
+void mem_restore_vars(struct saved_vars *saved);
+int memstat(char *args[], int n_args);
 
 #endif
@@ -0,0 +1,450 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simulate.h"
+#include "policy.h"
+#include "scheduler.h"
+#include "shellmemory.h"
+#include "backing_store.h"
+#include "interpreter.h"
+#include "output.h"
+#include "timing.h"
+#include "replay.h"
+
+#define DEFAULT_INSTRUCTION_NS 250 // Default virtual cost of an instruction (about a read and run in bench/microbench)
+#define DEFAULT_PAGE_IN_NS 6000    // Default virtual cost of a page-in (load_from_backing_store in bench/microbench)
+#define TURNAROUND_QUANTILE 0.99   // Tail of the turnaround times reported next to their mean
+#define MIN_SCRIPT_SLOTS 64        // Initial number of slots of the script hash table (power of 2)
+
+struct sim_results // Processes that exited during the simulation of one policy
+{
+    long long *turnarounds;           // Launch to exit time of each process (virtual ns)
+    int n;                            // Number of processes
+    int cap;                          // Allocated capacity of turnarounds
+    long long wait_ns;                // Sum of the times processes spent in the ready queue or blocked on a page-in
+    unsigned long long faults;        // Sum of the page faults of the processes
+};
+
+struct sim_script // Script read and parsed once for every process running it in the simulation
+{
+    char *name;                 // File name of the script
+    int n_lines;                // Number of lines
+    struct parsed_line **lines; // Parsed lines (one reference each)
+    struct flow_entry *flow;    // Compiled control flow (NULL if the script has no control statements)
+};
+
+struct sim_scripts // Scripts read so far by the current simulate command
+{
+    struct sim_script *scripts;
+    int n;
+    int cap;
+    int *slots;  // Hash table of scripts by name (open addressing, index in scripts or -1), at most half full
+    int n_slots; // Number of slots (power of 2)
+};
+
+static struct sim_results results;
+static struct sim_scripts sim_scripts;
+int simulating = 0;
+struct sim_costs sim_costs;
+
+struct sim_script *find_sim_script(struct pcb *p);
+int *sim_script_slot(const char *name);
+int grow_sim_script_slots();
+int read_sim_script(struct pcb *p, struct sim_script *s);
+void free_sim_scripts();
+int by_duration(const void *a, const void *b);
+void print_sim_results(const char *policy, long long makespan);
+int badcommandSimulate();
+int error_simulate_busy();
+
+/*
+ * Function:  simulate
+ * --------------------
+ * simulate builtin: runs the scripts of an exec manifest under every scheduling policy on a virtual clock, and prints
+ * one line per policy: makespan, throughput, mean and p99 turnaround, mean wait and page faults.
+ *   simulate MANIFEST [INSTRUCTION_NS [PAGE_IN_NS]]
+ *
+ * Processes go through the real ready queue, policies and paging (frames, evictions, blocking on faults), but the
+ * clock only advances by INSTRUCTION_NS per instruction and PAGE_IN_NS per page-in, so results are deterministic and
+ * independent of the machine. Only the set commands of instructions run (control statements depend on them):
+ * external programs, builtins and the processes scripts would launch are skipped, and nothing is printed.
+ * Each script is read and parsed once (see load_simulated_script), so neither its launch nor its page-ins touch the
+ * backing store.
+ * Every policy starts with an empty variable store. The user's variables are saved before and restored afterwards.
+ *
+ * char *args[]: arguments (without the command name)
+ * int n_args: number of arguments
+ *
+ * returns (int): status
+ */
+int simulate(char *args[], int n_args)
+{
+    long long costs[2] = {DEFAULT_INSTRUCTION_NS, DEFAULT_PAGE_IN_NS};
+
+    for (int i = 1; i < n_args; i++)
+    {
+        costs[i - 1] = atoll(args[i]);
+        if (costs[i - 1] <= 0)
+            return badcommandSimulate();
+    }
+    if (current_job() != -1 || processes_waiting())
+        return error_simulate_busy(); // The simulated processes share the scheduler and the frames
+
+    struct saved_vars *saved_vars = mem_save_vars();
+    if (saved_vars == NULL)
+    {
+        perror("Unable to save variables for simulate");
+        return 1;
+    }
+
+    const struct sched_policy *saved_policy = current_policy();
+    int saved_timing = timing; // time simulate reports the real time, its phases would be measured in virtual time
+    char *exec_args[] = {"exec", "-f", args[0], NULL};
+    int status = 0;
+
+    sim_costs.instruction = costs[0];
+    sim_costs.page_in = costs[1];
+
+    for (int i = 0; sched_policies[i] != NULL; i++)
+    {
+        exec_args[3] = (char *)sched_policies[i]->name;
+        clear_shell_mem(); // Every policy starts from the same variables
+        results.n = 0;
+        results.wait_ns = 0;
+        results.faults = 0;
+
+        timing = 0;
+        set_virtual_clock(1);
+        simulating = 1;
+        long long start = monotonic_ns();
+        status = interpreter(exec_args, 4);
+        out_mute(1); // Errors of the scripts (e.g. variable store full) would repeat for every policy
+        if (run_scheduler_until_done(-1) != 0) // Also finishes what was launched if exec failed
+            status = 1;
+        out_mute(0);
+        long long makespan = monotonic_ns() - start;
+        simulating = 0;
+        set_virtual_clock(0);
+        timing = saved_timing;
+
+        if (status != 0)
+            break;
+        if (i == 0) // The manifest could be run
+        {
+            out_printf("Simulated %s: instruction %lld ns, page-in %lld ns (virtual time)\n", args[0], costs[0], costs[1]);
+            out_printf("%-8s %-7s %-13s %-19s %-15s %-12s %-12s %s\n", "POLICY", "PROCS", "MAKESPAN(ms)",
+                       "THROUGHPUT(proc/s)", "TURNAROUND(ms)", "P99(ms)", "WAIT(ms)", "FAULTS");
+        }
+        print_sim_results(sched_policies[i]->name, makespan);
+    }
+
+    mem_restore_vars(saved_vars);
+    free_sim_scripts();
+    free(results.turnarounds);
+    results.turnarounds = NULL;
+    results.cap = 0;
+    set_scheduler_policy(saved_policy);
+    return status;
+}
+
+/*
+ * Function:  load_simulated_script
+ * --------------------
+ * Gives a simulated process its script (instead of copying it into the backing store, see materialize_process): the
+ * parsed lines pages are loaded from, and its own copy of the compiled control flow (for loops keep their position
+ * in it)
+ *
+ * struct pcb *p: pcb of process stub (see load_script)
+ *
+ * returns (int): status (0 on success, -1 on failure)
+ */
+int load_simulated_script(struct pcb *p)
+{
+    struct sim_script *s = find_sim_script(p);
+    if (s == NULL)
+        return -1;
+
+    if (s->flow != NULL)
+    {
+        p->flow = malloc(s->n_lines * sizeof(struct flow_entry));
+        if (p->flow == NULL)
+            return -1;
+        memcpy(p->flow, s->flow, s->n_lines * sizeof(struct flow_entry));
+    }
+    p->bound = s->n_lines;
+    p->lines = s->lines;
+    p->materialized = 1;
+    return 0;
+}
+
+/*
+ * Function:  find_sim_script
+ * --------------------
+ * Finds the script of a process among the scripts read by the current simulate command, reading it if needed.
+ * Scripts are looked up by name in a hash table, so manifests of many scripts take one lookup per process.
+ *
+ * struct pcb *p: process running the script
+ *
+ * returns (struct sim_script *): script, NULL if it could not be read
+ */
+struct sim_script *find_sim_script(struct pcb *p)
+{
+    if (2 * (sim_scripts.n + 1) > sim_scripts.n_slots && grow_sim_script_slots() != 0)
+        return NULL;
+
+    int *slot = sim_script_slot(p->script);
+    if (*slot != -1)
+        return &sim_scripts.scripts[*slot];
+
+    if (sim_scripts.n == sim_scripts.cap)
+    {
+        int new_cap = sim_scripts.cap == 0 ? 16 : sim_scripts.cap * 2;
+        struct sim_script *grown = realloc(sim_scripts.scripts, new_cap * sizeof(struct sim_script));
+        if (grown == NULL)
+            return NULL;
+        sim_scripts.scripts = grown;
+        sim_scripts.cap = new_cap;
+    }
+
+    struct sim_script *s = &sim_scripts.scripts[sim_scripts.n];
+    if (read_sim_script(p, s) != 0)
+        return NULL;
+    *slot = sim_scripts.n++;
+    return s;
+}
+
+/*
+ * Function:  sim_script_slot
+ * --------------------
+ * Finds the slot of a script in the hash table (linear probing from the FNV-1a hash of its name, see log_checksum)
+ *
+ * const char *name: file name of the script
+ *
+ * returns (int *): slot holding the script, or the empty slot it would go in
+ */
+int *sim_script_slot(const char *name)
+{
+    unsigned int mask = sim_scripts.n_slots - 1;
+    unsigned int i = log_checksum(LOG_CHECKSUM_INIT, name, strlen(name)) & mask;
+
+    while (sim_scripts.slots[i] != -1 && strcmp(sim_scripts.scripts[sim_scripts.slots[i]].name, name) != 0)
+        i = (i + 1) & mask;
+    return &sim_scripts.slots[i];
+}
+
+/*
+ * Function:  grow_sim_script_slots
+ * --------------------
+ * Doubles the hash table of scripts (or creates it) and inserts the scripts read so far again
+ *
+ * returns (int): status (0 on success, -1 if out of memory)
+ */
+int grow_sim_script_slots()
+{
+    int n_slots = sim_scripts.n_slots == 0 ? MIN_SCRIPT_SLOTS : sim_scripts.n_slots * 2;
+    int *slots = malloc(n_slots * sizeof(int));
+    if (slots == NULL)
+        return -1;
+
+    free(sim_scripts.slots);
+    sim_scripts.slots = slots;
+    sim_scripts.n_slots = n_slots;
+    for (int i = 0; i < n_slots; i++)
+        slots[i] = -1;
+    for (int i = 0; i < sim_scripts.n; i++)
+        *sim_script_slot(sim_scripts.scripts[i].name) = i;
+    return 0;
+}
+
+/*
+ * Function:  read_sim_script
+ * --------------------
+ * Reads and parses a script in one pass over the file. Lines are numbered and control statements recognized like
+ * when the script is copied into the backing store (see cp_to_store), which is left untouched.
+ *
+ * struct pcb *p: process running the script
+ * struct sim_script *s: set to the script
+ *
+ * returns (int): status (0 on success, -1 on failure)
+ */
+int read_sim_script(struct pcb *p, struct sim_script *s)
+{
+    struct pcb script = {.pid = p->pid, .script = p->script}; // Gets the compiled control flow (see build_flow)
+    struct flow_mark *marks = NULL;
+    int n_marks = 0, marks_cap = 0, lines_cap = 0, ok = 1;
+    unsigned int checksum = LOG_CHECKSUM_INIT;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+
+    FILE *f = fopen(p->script, "rb");
+    if (f == NULL)
+        return -1;
+
+    s->n_lines = 0;
+    s->lines = NULL;
+    // Lines are split at newlines, an empty script is a single blank line
+    while (ok && ((len = getline(&line, &size, f)) != -1 || s->n_lines == 0))
+    {
+        if (len == -1)
+            len = 0;
+        if (log_mode != LOG_OFF)
+            checksum = log_checksum(checksum, line, len);
+
+        if (s->n_lines == lines_cap)
+        {
+            lines_cap = lines_cap == 0 ? 16 : lines_cap * 2;
+            struct parsed_line **grown = realloc(s->lines, lines_cap * sizeof(struct parsed_line *));
+            if ((ok = grown != NULL))
+                s->lines = grown;
+        }
+        flow_kind_t kind = len > 0 ? line_flow_kind(line, line + len) : FLOW_NONE;
+        if (ok && kind != FLOW_NONE && n_marks == marks_cap)
+        {
+            marks_cap = marks_cap == 0 ? 8 : marks_cap * 2;
+            struct flow_mark *grown = realloc(marks, marks_cap * sizeof(struct flow_mark));
+            if ((ok = grown != NULL))
+                marks = grown;
+        }
+        if (!ok)
+            break;
+        if (kind != FLOW_NONE)
+            marks[n_marks++] = (struct flow_mark){s->n_lines, kind};
+        s->lines[s->n_lines++] = parse_line(len > 0 ? line : "");
+    }
+    free(line);
+    fclose(f);
+    LOG_EVENT(LOG_SCRIPT, p->pid, checksum);
+
+    script.bound = s->n_lines;
+    s->name = strdup(p->script);
+    if (!ok || s->name == NULL || !build_flow(&script, marks, n_marks))
+    {
+        for (int i = 0; i < s->n_lines; i++)
+            release_line(s->lines[i]);
+        free(s->lines);
+        free(s->name);
+        free(marks);
+        return -1;
+    }
+    s->flow = script.flow;
+    free(marks);
+    return 0;
+}
+
+/*
+ * Function:  free_sim_scripts
+ * --------------------
+ * Frees the scripts read by the simulate command (lines still held by frames are freed once they are evicted)
+ */
+void free_sim_scripts()
+{
+    for (int i = 0; i < sim_scripts.n; i++)
+    {
+        struct sim_script *s = &sim_scripts.scripts[i];
+        for (int j = 0; j < s->n_lines; j++)
+            release_line(s->lines[j]);
+        free(s->lines);
+        free(s->flow);
+        free(s->name);
+    }
+    free(sim_scripts.scripts);
+    free(sim_scripts.slots);
+    sim_scripts.scripts = NULL;
+    sim_scripts.n = 0;
+    sim_scripts.cap = 0;
+    sim_scripts.slots = NULL;
+    sim_scripts.n_slots = 0;
+}
+
+/*
+ * Function:  simulated_exit
+ * --------------------
+ * Collects the results of a process that terminated while simulating (called by the scheduler before it is freed)
+ *
+ * struct pcb *p: terminated process
+ */
+void simulated_exit(struct pcb *p)
+{
+    if (results.n == results.cap)
+    {
+        int new_cap = results.cap == 0 ? 64 : results.cap * 2;
+        long long *grown = realloc(results.turnarounds, new_cap * sizeof(long long));
+        if (grown == NULL)
+        {
+            perror("Unable to allocate simulation results");
+            exit(1);
+        }
+        results.turnarounds = grown;
+        results.cap = new_cap;
+    }
+
+    results.turnarounds[results.n++] = monotonic_ns() - p->stats.launched;
+    results.wait_ns += p->stats.wait_ns;
+    results.faults += p->stats.faults;
+}
+
+/*
+ * Function:  print_sim_results
+ * --------------------
+ * Prints the line of a simulated policy
+ *
+ * const char *policy: name of the policy
+ * long long makespan: virtual time until every process terminated (ns)
+ */
+void print_sim_results(const char *policy, long long makespan)
+{
+    long long sum = 0, tail = 0;
+    double n = results.n > 0 ? results.n : 1;
+
+    qsort(results.turnarounds, results.n, sizeof(long long), by_duration);
+    for (int i = 0; i < results.n; i++)
+        sum += results.turnarounds[i];
+    if (results.n > 0)
+    {
+        int rank = (int)(TURNAROUND_QUANTILE * results.n + 0.999999); // Nearest rank (ceil)
+        tail = results.turnarounds[(rank > 0 ? rank : 1) - 1];
+    }
+
+    out_printf("%-8s %-7d %-13.3f %-19.1f %-15.3f %-12.3f %-12.3f %llu\n", policy, results.n, makespan / 1e6,
+               makespan > 0 ? results.n / (makespan / 1e9) : 0.0, sum / n / 1e6, tail / 1e6, results.wait_ns / n / 1e6,
+               results.faults);
+}
+
+/*
+ * Function:  by_duration
+ * --------------------
+ * qsort comparator of durations (ascending)
+ */
+int by_duration(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Function:  badcommandSimulate
+ * --------------------
+ * Indicates that simulate was given arguments it does not understand
+ *
+ * returns (int): status
+ */
+int badcommandSimulate()
+{
+    out_printf("%s\n", "Bad command: Expected simulate MANIFEST [INSTRUCTION_NS [PAGE_IN_NS]] (costs > 0)");
+    return 22;
+}
+
+/*
+ * Function:  error_simulate_busy
+ * --------------------
+ * Prints error when simulate is started while processes are running or from a script
+ *
+ * returns (int): status
+ */
+int error_simulate_busy()
+{
+    out_printf("%s\n", "Error: simulate can only run from the prompt once every process is done (see wait)");
+    return 23;
+}
@@ -0,0 +1,31 @@
+#ifndef SIMULATE_H
+#define SIMULATE_H
+#include "pcb.h"
+#include "clock.h"
+
+struct sim_costs // Virtual time charged while simulating (ns)
+{
+    long long instruction; // Executing one instruction
+    long long page_in;     // Loading one page into a frame
+};
+
+extern int simulating; // Indicator (1 while simulate runs processes), read directly by SIM_CHARGE
+extern struct sim_costs sim_costs;
+
+/*
+ * Macro:  SIM_CHARGE
+ * --------------------
+ * Advances the virtual clock by a cost (a field of struct sim_costs) while simulating
+ */
+#define SIM_CHARGE(cost)                          \
+    do                                            \
+    {                                             \
+        if (simulating)                           \
+            advance_clock(sim_costs.cost);        \
+    } while (0)
+
+int load_simulated_script(struct pcb *p);
+void simulated_exit(struct pcb *p);
+int simulate(char *args[], int n_args);
+
+#endif
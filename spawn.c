@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "spawn.h"
+#include "tokenizer.h"
+#include "scheduler.h"
+#include "output.h"
+#include "clock.h"
+#include "replay.h"
+
+#define EXIT_SIGNALED_BASE 128 // Status of a program killed by a signal is this plus the signal number (like sh)
+
+extern char **environ;
+
+struct pipeline // External programs connected by pipes (a | b | c)
+{
+    char **argv;  // argv of every stage, each terminated by NULL
+    int *first;   // Index in argv of each stage's first word
+    int n_stages; // Number of stages
+    pid_t *pids;  // Process of each stage (-1 if it was not started or has been waited for)
+    int status;   // Exit status of the last stage (1 until it is waited for, see reap_pipeline)
+    long long start; // Time the pipeline was started (ns, monotonic clock)
+};
+
+static int child_exits[2] = {-1, -1}; // Self-pipe written by the SIGCHLD handler, so a poll can also wait for children
+static struct pipeline *suspended;    // Pipeline of the command that returned EXTERNAL_SUSPENDED (see take_suspended)
+
+int badcommand();
+int build_pipeline(char *words[], int n_words, struct pipeline *pl);
+void free_pipeline(struct pipeline *pl);
+int start_pipeline(struct pipeline *pl);
+int wait_pipeline(struct pipeline *pl);
+int reap_pipeline(struct pipeline *pl, int block);
+void on_child_exit(int sig);
+
+/*
+ * Function:  init_spawn
+ * --------------------
+ * Sets up the notification of exiting children used to wait for input and external programs at the same time
+ * (see wait_input_or_exit). Without it, background programs are waited for without watching the input.
+ */
+void init_spawn()
+{
+    struct sigaction sa;
+
+    if (pipe(child_exits) == -1)
+    {
+        child_exits[0] = child_exits[1] = -1;
+        return;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        fcntl(child_exits[i], F_SETFD, FD_CLOEXEC);                               // Not inherited by programs
+        fcntl(child_exits[i], F_SETFL, fcntl(child_exits[i], F_GETFL) | O_NONBLOCK); // Handler never blocks
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_child_exit;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP; // Blocking reads and waits of the shell are not interrupted
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCHLD, &sa, NULL);
+}
+
+/*
+ * Function:  on_child_exit
+ * --------------------
+ * SIGCHLD handler, wakes up wait_input_or_exit
+ */
+void on_child_exit(int sig)
+{
+    int saved_errno = errno;
+    char c = 0;
+    if (write(child_exits[1], &c, 1) == -1)
+        ; // Pipe full, a wakeup is already pending
+    errno = saved_errno;
+}
+
+/*
+ * Function:  wait_input_or_exit
+ * --------------------
+ * Blocks until input is available on fd (or it reached end of file) or a child process exited
+ *
+ * int fd: input to watch
+ *
+ * returns (int): Indicator (1 if input is pending, 0 if a child exited)
+ */
+int wait_input_or_exit(int fd)
+{
+    struct pollfd pfds[2] = {{fd, POLLIN, 0}, {child_exits[0], POLLIN, 0}};
+    char drain[64];
+
+    while (poll(pfds, child_exits[0] != -1 ? 2 : 1, -1) == -1)
+    {
+        if (errno != EINTR)
+            return 1;
+    }
+    while (child_exits[0] != -1 && read(child_exits[0], drain, sizeof(drain)) > 0)
+        ; // Consume the wakeups, the caller checks every child it waits for
+    return pfds[0].revents != 0;
+}
+
+/*
+ * Function:  run_external
+ * --------------------
+ * Runs a command that is not a builtin as an external program (looked up in PATH), or a pipeline of programs whose
+ * stages are separated by '|'. Stages are started with posix_spawn and connected directly with pipes, so the shell
+ * never copies the data flowing between them. The shell waits for every stage to finish.
+ * The time it waits is charged to the process running the command (see charge_external_time).
+ *
+ * If the command may be suspended (an instruction of a background job run while the prompt waits for input, see
+ * external_may_suspend), it does not hold up the prompt: if input arrives before the programs are done,
+ * EXTERNAL_SUSPENDED is returned and the scheduler takes the pipeline over (see take_suspended) to finish the
+ * instruction once they exited.
+ *
+ * char *words[]: words of the command, stages separated by the pipe word (see is_pipe)
+ * int n_words: number of words
+ * int may_suspend: Indicator (1 if EXTERNAL_SUSPENDED may be returned)
+ *
+ * returns (int): exit status of the last stage, 1 if a program could not be started, or EXTERNAL_SUSPENDED
+ */
+int run_external(char *words[], int n_words, int may_suspend)
+{
+    struct pipeline pl;
+    int status;
+
+    if (!build_pipeline(words, n_words, &pl))
+        return badcommand();
+
+    // Children write to the same stdout, what the shell printed so far must come first
+    out_flush();
+
+    pl.start = monotonic_ns();
+    status = start_pipeline(&pl);
+    if (status == 0 && may_suspend)
+    {
+        int input = 0;
+        while (!input && !reap_pipeline(&pl, 0))
+            input = wait_input_or_exit(STDIN_FILENO);
+
+        // Whether the programs finished before the input arrived depends on timing
+        if (LOG_FORCE(LOG_SUSPEND, 0, input))
+        {
+            // Not charged: the process does not run until they exited (see suspend_current)
+            suspended = malloc(sizeof(struct pipeline));
+            if (suspended != NULL)
+            {
+                *suspended = pl;
+                return EXTERNAL_SUSPENDED;
+            }
+        }
+    }
+    int last_status = wait_pipeline(&pl);
+    charge_external_time(monotonic_ns() - pl.start);
+
+    if (status == 0)
+        status = last_status;
+    else
+        badcommand(); // A stage could not be started (most likely no such program)
+
+    free_pipeline(&pl);
+    return status;
+}
+
+/*
+ * Function:  take_suspended
+ * --------------------
+ * returns (struct pipeline *): pipeline of the command that just returned EXTERNAL_SUSPENDED, now owned by the caller
+ *                              (see external_done and free_suspended)
+ */
+struct pipeline *take_suspended()
+{
+    struct pipeline *pl = suspended;
+    suspended = NULL;
+    return pl;
+}
+
+/*
+ * Function:  external_done
+ * --------------------
+ * Checks whether the programs of a suspended command exited
+ *
+ * struct pipeline *pl: pipeline (see take_suspended)
+ * int block: 1 to wait until they exited
+ *
+ * returns (int): Indicator (1 if every program exited, 0 otherwise)
+ */
+int external_done(struct pipeline *pl, int block)
+{
+    return reap_pipeline(pl, block);
+}
+
+/*
+ * Function:  free_suspended
+ * --------------------
+ * Waits for the programs of a suspended command that are still running, then frees its pipeline
+ *
+ * struct pipeline *pl: pipeline (see take_suspended)
+ */
+void free_suspended(struct pipeline *pl)
+{
+    reap_pipeline(pl, 1);
+    free_pipeline(pl);
+    free(pl);
+}
+
+/*
+ * Function:  build_pipeline
+ * --------------------
+ * Splits the words of a command into the argv of each stage
+ *
+ * char *words[]: words of the command
+ * int n_words: number of words
+ * struct pipeline *pl: pipeline to fill (to be freed with free_pipeline if built)
+ *
+ * returns (int): Indicator (1 if built, 0 if a stage is empty)
+ */
+int build_pipeline(char *words[], int n_words, struct pipeline *pl)
+{
+    int n_stages = 1;
+    for (int i = 0; i < n_words; i++)
+    {
+        if (is_pipe(words[i]))
+            n_stages++;
+    }
+
+    // Each pipe word becomes the NULL ending its stage, the last stage gets one more
+    pl->argv = malloc((n_words + 1) * sizeof(char *));
+    pl->first = malloc(n_stages * sizeof(int));
+    pl->pids = malloc(n_stages * sizeof(pid_t));
+    if (pl->argv == NULL || pl->first == NULL || pl->pids == NULL)
+    {
+        free_pipeline(pl);
+        return 0;
+    }
+
+    pl->status = 1;
+    pl->n_stages = 0;
+    pl->first[pl->n_stages++] = 0;
+    for (int i = 0; i < n_words; i++)
+    {
+        if (is_pipe(words[i]))
+        {
+            pl->argv[i] = NULL;
+            pl->first[pl->n_stages++] = i + 1;
+        }
+        else
+        {
+            pl->argv[i] = words[i];
+        }
+    }
+    pl->argv[n_words] = NULL;
+
+    for (int s = 0; s < pl->n_stages; s++)
+    {
+        pl->pids[s] = -1;
+        char *name = pl->argv[pl->first[s]];
+        if (name == NULL || name[0] == '\0') // Nothing before/after a '|' (or an empty line)
+        {
+            free_pipeline(pl);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Function:  free_pipeline
+ * --------------------
+ * Frees the arrays of a pipeline (the words themselves belong to the command)
+ */
+void free_pipeline(struct pipeline *pl)
+{
+    free(pl->argv);
+    free(pl->first);
+    free(pl->pids);
+}
+
+/*
+ * Function:  start_pipeline
+ * --------------------
+ * Starts every stage, stage i writing into a pipe read by stage i + 1. The first stage reads the shell's stdin and the
+ * last one writes to the shell's stdout. Stages are started even if an earlier one failed, so that the others see
+ * end of file / broken pipe instead of waiting forever.
+ *
+ * struct pipeline *pl: pipeline to start (its pids are set)
+ *
+ * returns (int): 0 if every stage started, 1 otherwise
+ */
+int start_pipeline(struct pipeline *pl)
+{
+    int status = 0;
+    int in_fd = STDIN_FILENO; // Read end of the previous stage's pipe
+
+    for (int s = 0; s < pl->n_stages; s++)
+    {
+        int fds[2] = {-1, -1};
+        int out_fd = STDOUT_FILENO;
+        posix_spawn_file_actions_t actions;
+
+        if (s < pl->n_stages - 1)
+        {
+            if (pipe(fds) == -1)
+            {
+                status = 1;
+                break;
+            }
+            out_fd = fds[1];
+        }
+
+        posix_spawn_file_actions_init(&actions);
+        if (in_fd != STDIN_FILENO)
+        {
+            posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+            posix_spawn_file_actions_addclose(&actions, in_fd);
+        }
+        if (out_fd != STDOUT_FILENO)
+        {
+            posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+            posix_spawn_file_actions_addclose(&actions, out_fd);
+            posix_spawn_file_actions_addclose(&actions, fds[0]); // Read end belongs to the next stage
+        }
+
+        char **argv = pl->argv + pl->first[s];
+        if (posix_spawnp(&pl->pids[s], argv[0], &actions, NULL, argv, environ) != 0)
+        {
+            pl->pids[s] = -1;
+            status = 1;
+        }
+        posix_spawn_file_actions_destroy(&actions);
+
+        // The children hold their own copies of the pipe ends
+        if (in_fd != STDIN_FILENO)
+            close(in_fd);
+        if (out_fd != STDOUT_FILENO)
+            close(out_fd);
+        in_fd = fds[0];
+    }
+
+    if (in_fd != STDIN_FILENO && in_fd != -1)
+        close(in_fd);
+    return status;
+}
+
+/*
+ * Function:  wait_pipeline
+ * --------------------
+ * Waits for every started stage of a pipeline
+ *
+ * returns (int): exit status of the last stage (EXIT_SIGNALED_BASE + signal if it was killed, 1 if it was not started)
+ */
+int wait_pipeline(struct pipeline *pl)
+{
+    reap_pipeline(pl, 1);
+    return pl->status;
+}
+
+/*
+ * Function:  reap_pipeline
+ * --------------------
+ * Waits for the stages of a pipeline that exited (or for all of them), recording the exit status of the last stage
+ *
+ * struct pipeline *pl: pipeline
+ * int block: 1 to wait until every stage exited, 0 to only collect the stages that already did
+ *
+ * returns (int): Indicator (1 if every stage has exited, 0 otherwise)
+ */
+int reap_pipeline(struct pipeline *pl, int block)
+{
+    int done = 1;
+
+    for (int s = 0; s < pl->n_stages; s++)
+    {
+        int wstatus = 0;
+        pid_t pid;
+        if (pl->pids[s] == -1)
+            continue;
+
+        while ((pid = waitpid(pl->pids[s], &wstatus, block ? 0 : WNOHANG)) == -1)
+        {
+            if (errno != EINTR)
+                break;
+        }
+        if (pid == 0)
+        {
+            done = 0; // Still running
+            continue;
+        }
+        pl->pids[s] = -1;
+
+        if (s == pl->n_stages - 1)
+        {
+            if (WIFEXITED(wstatus))
+                pl->status = WEXITSTATUS(wstatus);
+            else if (WIFSIGNALED(wstatus))
+                pl->status = EXIT_SIGNALED_BASE + WTERMSIG(wstatus);
+        }
+    }
+    return done;
+}
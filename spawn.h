@@ -0,0 +1,15 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#define EXTERNAL_SUSPENDED -2 // Status of an external command left running in the background (see run_external)
+
+struct pipeline; // External programs connected by pipes (spawn.c)
+
+void init_spawn();
+int run_external(char *words[], int n_words, int may_suspend);
+struct pipeline *take_suspended();
+int external_done(struct pipeline *pl, int block);
+void free_suspended(struct pipeline *pl);
+int wait_input_or_exit(int fd);
+
+#endif
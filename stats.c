@@ -0,0 +1,400 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+#include "output.h"
+
+#define STATS_ON "on"
+#define STATS_OFF "off"
+#define MAX_STATS 48                      // Number of latency histograms (fixed ones and registered builtins)
+#define DEFAULT_EXPORT_INTERVAL_MS 10000  // Time between two writes of the metrics file
+#define EXPORT_TMP_SUFFIX ".tmp"          // The metrics file is written next to its path and renamed over it
+
+// Histograms are log-linear, like HdrHistogram: values below SUB_BUCKETS ns are counted exactly, and every power of
+// two above is split into SUB_BUCKETS buckets, so a bucket is never wider than 1/SUB_BUCKETS of its values (6.25%)
+#define SUB_BUCKET_BITS 4
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define MAX_VALUE_BITS 42 // Latencies from 2^42 ns (~73 minutes) on share the last bucket
+#define N_BUCKETS ((MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS)
+
+struct latency_histogram // Latencies of one command
+{
+    unsigned long long count;  // Number of latencies recorded
+    unsigned long long sum;    // Sum of the latencies (ns)
+    long long max;             // Largest latency (ns)
+    unsigned long long buckets[N_BUCKETS];
+};
+
+struct stats_state
+{
+    struct latency_histogram hists[MAX_STATS]; // By stat id
+    const char *names[MAX_STATS];              // By stat id
+    int n;                                     // Number of stat ids in use
+    char *export_path;                         // Metrics file (NULL if metrics are not exported)
+    char *export_tmp;                          // Temporary file renamed over export_path
+    long long export_interval;                 // Time between two writes of the metrics file (ns)
+    long long next_export;                     // Time of the next write of the metrics file (ns, monotonic clock)
+} s_state = {.names = {"page_in", "external"}, .n = N_FIXED_STATS};
+
+int stats_enabled = 0;
+
+const double quantiles[] = {0.5, 0.9, 0.99, 0.999}; // Reported by stats and in the metrics file
+#define N_QUANTILES (sizeof(quantiles) / sizeof(quantiles[0]))
+
+int bucket_of(long long value);
+long long bucket_value(int bucket);
+long long quantile(struct latency_histogram *h, double q);
+void print_stats();
+void format_latency(char *buf, size_t size, long long ns);
+int set_export(char *args[], int n_args);
+int export_metrics();
+void export_at_exit();
+int badcommandStats();
+int error_stats_export_failed(const char *file);
+
+/*
+ * Function:  stats_register
+ * --------------------
+ * Creates the latency histogram of a command
+ *
+ * const char *name: name of the command (not copied, must stay valid)
+ *
+ * returns (int): stat id passed to STATS_RECORD, -1 if every histogram is in use
+ */
+int stats_register(const char *name)
+{
+    if (s_state.n == MAX_STATS)
+        return -1;
+    s_state.names[s_state.n] = name;
+    return s_state.n++;
+}
+
+/*
+ * Function:  stats_record
+ * --------------------
+ * Records the latency of an operation, and writes the metrics file when it is due.
+ * Use STATS_RECORD, which skips the call when stats are off.
+ *
+ * int id: stat id of the operation (see stats_register), ignored if -1
+ * long long start: start time of the operation (see STATS_START), 0 if stats were off when it started
+ */
+void stats_record(int id, long long start)
+{
+    if (id == -1 || start == 0)
+        return;
+
+    long long now = monotonic_ns();
+    long long latency = now - start;
+    struct latency_histogram *h = &s_state.hists[id];
+
+    h->count++;
+    h->sum += latency;
+    if (latency > h->max)
+        h->max = latency;
+    h->buckets[bucket_of(latency)]++;
+
+    if (s_state.export_path != NULL && now >= s_state.next_export)
+        export_metrics();
+}
+
+/*
+ * Function:  bucket_of
+ * --------------------
+ * Histogram bucket of a latency
+ *
+ * long long value: latency (ns)
+ *
+ * returns (int): bucket index
+ */
+int bucket_of(long long value)
+{
+    if (value < SUB_BUCKETS)
+        return value < 0 ? 0 : value;
+
+    int shift = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS; // Keep the SUB_BUCKET_BITS bits after the leading one
+    int bucket = (shift + 1) * SUB_BUCKETS + (int)((value >> shift) & (SUB_BUCKETS - 1));
+    return bucket < N_BUCKETS ? bucket : N_BUCKETS - 1;
+}
+
+/*
+ * Function:  bucket_value
+ * --------------------
+ * Latency a bucket stands for (middle of the latencies it counts)
+ *
+ * int bucket: bucket index
+ *
+ * returns (long long): latency (ns)
+ */
+long long bucket_value(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+
+    int shift = bucket / SUB_BUCKETS - 1;
+    long long low = (long long)(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+    return low + ((1LL << shift) >> 1);
+}
+
+/*
+ * Function:  quantile
+ * --------------------
+ * Latency below which a fraction q of the recorded latencies lie
+ *
+ * struct latency_histogram *h: histogram with at least one latency
+ * double q: fraction (0 < q <= 1)
+ *
+ * returns (long long): latency (ns), within a bucket width of the exact value
+ */
+long long quantile(struct latency_histogram *h, double q)
+{
+    unsigned long long rank = (unsigned long long)(q * h->count);
+    if (rank < q * h->count || rank == 0)
+        rank++; // Round up, the quantile is the rank-th smallest latency
+
+    unsigned long long seen = 0;
+    for (int b = 0; b < N_BUCKETS; b++)
+    {
+        seen += h->buckets[b];
+        if (seen >= rank)
+        {
+            long long value = bucket_value(b);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+/*
+ * Function:  stats
+ * --------------------
+ * stats builtin:
+ *   stats                          prints the latency of every command run since the last reset
+ *   stats on|off                   starts/stops recording latencies (off by default)
+ *   stats reset                    forgets recorded latencies
+ *   stats export FILE [INTERVAL_MS] writes the latencies to FILE in the Prometheus text format every INTERVAL_MS
+ *                                  (default 10000) while commands run, and at exit. Turns stats on.
+ *   stats export off               stops writing FILE
+ *
+ * char *args[]: arguments (without the command name)
+ * int n_args: number of arguments
+ *
+ * returns (int): status
+ */
+int stats(char *args[], int n_args)
+{
+    if (n_args == 0)
+        print_stats();
+    else if (n_args == 1 && strcmp(args[0], STATS_ON) == 0)
+        stats_enabled = 1;
+    else if (n_args == 1 && strcmp(args[0], STATS_OFF) == 0)
+        stats_enabled = 0;
+    else if (n_args == 1 && strcmp(args[0], "reset") == 0)
+        memset(s_state.hists, 0, sizeof(s_state.hists));
+    else if (n_args >= 2 && strcmp(args[0], "export") == 0)
+        return set_export(args + 1, n_args - 1);
+    else
+        return badcommandStats();
+
+    return 0;
+}
+
+/*
+ * Function:  print_stats
+ * --------------------
+ * Prints a table of the commands with recorded latencies: count, mean, quantiles and maximum
+ */
+void print_stats()
+{
+    char mean[16], max[16], q[N_QUANTILES][16];
+    int printed = 0;
+
+    out_printf("%-10s %10s %9s %9s %9s %9s %9s %9s\n", "COMMAND", "COUNT", "MEAN", "P50", "P90", "P99", "P99.9", "MAX");
+    for (int id = 0; id < s_state.n; id++)
+    {
+        struct latency_histogram *h = &s_state.hists[id];
+        if (h->count == 0)
+            continue;
+
+        format_latency(mean, sizeof(mean), h->sum / h->count);
+        format_latency(max, sizeof(max), h->max);
+        for (int i = 0; i < N_QUANTILES; i++)
+            format_latency(q[i], sizeof(q[i]), quantile(h, quantiles[i]));
+        out_printf("%-10s %10llu %9s %9s %9s %9s %9s %9s\n", s_state.names[id], h->count, mean, q[0], q[1], q[2], q[3],
+                   max);
+        printed = 1;
+    }
+
+    if (!printed)
+        out_printf("No latencies recorded%s\n", stats_enabled ? "" : " (turn recording on with: stats on)");
+}
+
+/*
+ * Function:  format_latency
+ * --------------------
+ * Formats a latency with the unit that keeps it short (ns, us, ms or s)
+ */
+void format_latency(char *buf, size_t size, long long ns)
+{
+    if (ns < 1000)
+        snprintf(buf, size, "%lldns", ns);
+    else if (ns < 1000000)
+        snprintf(buf, size, "%.1fus", ns / 1e3);
+    else if (ns < 1000000000)
+        snprintf(buf, size, "%.1fms", ns / 1e6);
+    else
+        snprintf(buf, size, "%.2fs", ns / 1e9);
+}
+
+/*
+ * Function:  set_export
+ * --------------------
+ * Handles "stats export FILE [INTERVAL_MS]" and "stats export off". The file is written once right away so a bad
+ * path is reported to the user instead of failing silently later.
+ *
+ * char *args[]: arguments after "export"
+ * int n_args: number of arguments (at least 1)
+ *
+ * returns (int): status
+ */
+int set_export(char *args[], int n_args)
+{
+    long long interval_ms = DEFAULT_EXPORT_INTERVAL_MS;
+    static int at_exit_registered = 0;
+
+    if (n_args == 1 && strcmp(args[0], STATS_OFF) == 0)
+    {
+        free(s_state.export_path);
+        free(s_state.export_tmp);
+        s_state.export_path = s_state.export_tmp = NULL;
+        return 0;
+    }
+
+    if (n_args > 2)
+        return badcommandStats();
+    if (n_args == 2)
+    {
+        char *end;
+        interval_ms = strtoll(args[1], &end, 10);
+        if (*args[1] == '\0' || *end != '\0' || interval_ms <= 0)
+            return badcommandStats();
+    }
+
+    char *path = strdup(args[0]);
+    char *tmp = malloc(strlen(args[0]) + sizeof(EXPORT_TMP_SUFFIX));
+    if (path == NULL || tmp == NULL)
+    {
+        free(path);
+        free(tmp);
+        return error_stats_export_failed(args[0]);
+    }
+    sprintf(tmp, "%s%s", args[0], EXPORT_TMP_SUFFIX);
+
+    free(s_state.export_path);
+    free(s_state.export_tmp);
+    s_state.export_path = path;
+    s_state.export_tmp = tmp;
+    s_state.export_interval = interval_ms * 1000000;
+    stats_enabled = 1;
+
+    if (!at_exit_registered)
+    {
+        atexit(export_at_exit);
+        at_exit_registered = 1;
+    }
+
+    if (export_metrics() != 0)
+    {
+        int status = error_stats_export_failed(path);
+        set_export((char *[]){STATS_OFF}, 1);
+        return status;
+    }
+    return 0;
+}
+
+/*
+ * Function:  export_metrics
+ * --------------------
+ * Writes the latencies to the metrics file in the Prometheus text exposition format, as a summary per command.
+ * The file is written under a temporary name and renamed, so a scraper (e.g. the node exporter's textfile
+ * collector) never reads a partial file.
+ *
+ * returns (int): 0 if the file was written, -1 otherwise
+ */
+int export_metrics()
+{
+    s_state.next_export = monotonic_ns() + s_state.export_interval;
+
+    FILE *f = fopen(s_state.export_tmp, "w");
+    if (f == NULL)
+        return -1;
+
+    fprintf(f, "# HELP mysh_command_latency_seconds Latency of shell commands (page_in: page loads from the backing "
+               "store, external: external programs)\n");
+    fprintf(f, "# TYPE mysh_command_latency_seconds summary\n");
+    for (int id = 0; id < s_state.n; id++)
+    {
+        struct latency_histogram *h = &s_state.hists[id];
+        if (h->count == 0)
+            continue;
+
+        for (int i = 0; i < N_QUANTILES; i++)
+            fprintf(f, "mysh_command_latency_seconds{command=\"%s\",quantile=\"%g\"} %.9f\n", s_state.names[id],
+                    quantiles[i], quantile(h, quantiles[i]) / 1e9);
+        fprintf(f, "mysh_command_latency_seconds_sum{command=\"%s\"} %.9f\n", s_state.names[id], h->sum / 1e9);
+        fprintf(f, "mysh_command_latency_seconds_count{command=\"%s\"} %llu\n", s_state.names[id], h->count);
+    }
+
+    fprintf(f, "# HELP mysh_command_latency_max_seconds Largest latency of shell commands\n");
+    fprintf(f, "# TYPE mysh_command_latency_max_seconds gauge\n");
+    for (int id = 0; id < s_state.n; id++)
+    {
+        if (s_state.hists[id].count != 0)
+            fprintf(f, "mysh_command_latency_max_seconds{command=\"%s\"} %.9f\n", s_state.names[id],
+                    s_state.hists[id].max / 1e9);
+    }
+
+    if (fclose(f) != 0 || rename(s_state.export_tmp, s_state.export_path) != 0)
+    {
+        remove(s_state.export_tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Function:  export_at_exit
+ * --------------------
+ * Writes the metrics file a last time when the shell exits, so the final latencies are not lost
+ */
+void export_at_exit()
+{
+    if (s_state.export_path != NULL)
+        export_metrics();
+}
+
+/*
+ * Function:  badcommandStats
+ * --------------------
+ * Indicates that stats was given arguments it does not understand
+ *
+ * returns (int): status
+ */
+int badcommandStats()
+{
+    out_printf("%s\n", "Bad command: Expected stats [on|off|reset|export FILE [INTERVAL_MS]|export off]");
+    return 20;
+}
+
+/*
+ * Function:  error_stats_export_failed
+ * --------------------
+ * Prints error when the metrics file could not be written
+ *
+ * returns (int): status
+ */
+int error_stats_export_failed(const char *file)
+{
+    out_printf("Error: Failed to write metrics to %s\n", file);
+    return 21;
+}
@@ -0,0 +1,37 @@
+#ifndef STATS_H
+#define STATS_H
+#include "clock.h"
+
+enum // Latency histograms that are not builtins (builtins get theirs from stats_register)
+{
+    STAT_PAGE_IN,   // Loading a page from the backing store into a frame
+    STAT_EXTERNAL,  // Running an external program or pipeline
+    N_FIXED_STATS
+};
+
+extern int stats_enabled; // Indicator (1 while latencies are recorded), read directly by STATS_START/STATS_RECORD
+
+/*
+ * Macro:  STATS_START
+ * --------------------
+ * Start time of a measured operation, 0 without reading the clock when stats are off
+ */
+#define STATS_START() (stats_enabled ? monotonic_ns() : 0)
+
+/*
+ * Macro:  STATS_RECORD
+ * --------------------
+ * Records the latency of an operation started at start (see STATS_START) if stats are on
+ */
+#define STATS_RECORD(id, start)           \
+    do                                    \
+    {                                     \
+        if (stats_enabled)                \
+            stats_record((id), (start));  \
+    } while (0)
+
+int stats_register(const char *name);
+void stats_record(int id, long long start);
+int stats(char *args[], int n_args);
+
+#endif
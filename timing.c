@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <sys/resource.h>
+
+#include "timing.h"
+#include "interpreter.h"
+#include "scheduler.h"
+#include "jobs.h"
+#include "output.h"
+
+struct time_sample // Everything the time command reports, taken before and after the command
+{
+    long long wall;            // Monotonic clock (ns)
+    struct rusage self;        // Resources of the shell
+    struct rusage children;    // Resources of the external programs it waited for
+    struct phase_times phases; // Phases of running processes
+};
+
+int timing = 0;
+struct phase_times phases;
+
+void take_sample(struct time_sample *s);
+long long timeval_ns(struct timeval *tv);
+long long cpu_ns(struct time_sample *before, struct time_sample *after, int user);
+void print_times(struct time_sample *before, struct time_sample *after);
+
+/*
+ * Function:  time_command
+ * --------------------
+ * Runs a command and reports its real (wall), user and system time. External programs the command runs are included
+ * in user and system time.
+ * At the prompt, processes the command launches in the foreground (run, exec) run to completion before the report,
+ * which then breaks their time down into backing store copies, page-ins, execution of instructions and the rest
+ * (scheduler: dispatching, queue upkeep, launching), with fault, dispatch and context switch counts.
+ * Inside a script, launched processes join the script's job and run later, so only their launch is timed.
+ *
+ * char *args[]: command to run, with its arguments
+ * int n_args: number of words of the command
+ *
+ * returns (int): exit status of the command
+ */
+int time_command(char *args[], int n_args)
+{
+    struct time_sample before, after;
+
+    timing++;
+    take_sample(&before);
+
+    int status = interpreter(args, n_args);
+    if (current_job() == -1 && foreground_jobs_running())
+        run_scheduler(); // As the main loop would right after the command
+
+    take_sample(&after);
+    timing--;
+
+    print_times(&before, &after);
+    return status;
+}
+
+/*
+ * Function:  take_sample
+ * --------------------
+ * Reads the clock, the resource usage of the shell and its children and the accumulated phases
+ */
+void take_sample(struct time_sample *s)
+{
+    getrusage(RUSAGE_SELF, &s->self);
+    getrusage(RUSAGE_CHILDREN, &s->children);
+    s->phases = phases;
+    s->wall = monotonic_ns();
+}
+
+/*
+ * Function:  timeval_ns
+ * --------------------
+ * returns (long long): duration of a struct timeval in ns
+ */
+long long timeval_ns(struct timeval *tv)
+{
+    return tv->tv_sec * 1000000000LL + tv->tv_usec * 1000LL;
+}
+
+/*
+ * Function:  cpu_ns
+ * --------------------
+ * CPU time used by the shell and its children between two samples
+ *
+ * int user: 1 for user time, 0 for system time
+ *
+ * returns (long long): CPU time (ns)
+ */
+long long cpu_ns(struct time_sample *before, struct time_sample *after, int user)
+{
+    if (user)
+        return timeval_ns(&after->self.ru_utime) - timeval_ns(&before->self.ru_utime) +
+               timeval_ns(&after->children.ru_utime) - timeval_ns(&before->children.ru_utime);
+    return timeval_ns(&after->self.ru_stime) - timeval_ns(&before->self.ru_stime) +
+           timeval_ns(&after->children.ru_stime) - timeval_ns(&before->children.ru_stime);
+}
+
+/*
+ * Function:  print_times
+ * --------------------
+ * Prints the report of the time command, with the breakdown of processes if any ran between the samples
+ */
+void print_times(struct time_sample *before, struct time_sample *after)
+{
+    static const char *phase_names[N_PHASES] = {"copy", "page-in", "exec"};
+    static const char *phase_units[N_PHASES] = {"scripts", "pages", "instructions"};
+    long long wall = after->wall - before->wall;
+
+    out_printf("real\t%12.3f ms\n", wall / 1e6);
+    out_printf("user\t%12.3f ms\n", cpu_ns(before, after, 1) / 1e6);
+    out_printf("sys\t%12.3f ms\n", cpu_ns(before, after, 0) / 1e6);
+
+    unsigned long long dispatches = after->phases.dispatches - before->phases.dispatches;
+    if (dispatches == 0 && after->phases.n[PHASE_COPY] == before->phases.n[PHASE_COPY])
+        return; // No process ran
+
+    long long rest = wall;
+    for (int i = 0; i < N_PHASES; i++)
+    {
+        long long ns = after->phases.ns[i] - before->phases.ns[i];
+        rest -= ns;
+        out_printf("%s\t%12.3f ms  %llu %s\n", phase_names[i], ns / 1e6, after->phases.n[i] - before->phases.n[i],
+                   phase_units[i]);
+    }
+    out_printf("sched\t%12.3f ms  %llu dispatches\n", (rest > 0 ? rest : 0) / 1e6, dispatches);
+    out_printf("faults\t%12llu\n", after->phases.faults - before->phases.faults);
+    out_printf("csw\t%12ld voluntary, %ld involuntary\n",
+               after->self.ru_nvcsw - before->self.ru_nvcsw + after->children.ru_nvcsw - before->children.ru_nvcsw,
+               after->self.ru_nivcsw - before->self.ru_nivcsw + after->children.ru_nivcsw - before->children.ru_nivcsw);
+}
@@ -0,0 +1,60 @@
+#ifndef TIMING_H
+#define TIMING_H
+#include "clock.h"
+
+typedef enum // Timed phases of running processes, reported by the time command
+{
+    PHASE_COPY,    // Copying a script into the backing store and compiling its control statements
+    PHASE_PAGE_IN, // Loading a page from the backing store into a frame
+    PHASE_EXEC,    // Running an instruction (including the external programs it starts)
+    N_PHASES
+} phase_t;
+
+struct phase_times // Accumulated while a time command runs (the command reports the difference)
+{
+    long long ns[N_PHASES];           // Time spent in each phase (ns)
+    unsigned long long n[N_PHASES];   // Number of times each phase ran (scripts, pages, instructions)
+    unsigned long long faults;        // Processes blocked on a page fault
+    unsigned long long dispatches;    // Processes given the CPU by the scheduler
+};
+
+extern int timing; // Number of time commands running, read directly by TIMING_START/TIMING_END/TIMING_COUNT
+extern struct phase_times phases;
+
+/*
+ * Macro:  TIMING_START
+ * --------------------
+ * Start time of a phase, 0 without reading the clock when no time command runs
+ */
+#define TIMING_START() (timing ? monotonic_ns() : 0)
+
+/*
+ * Macro:  TIMING_END
+ * --------------------
+ * Adds a phase started at start (see TIMING_START) to the accumulated times if a time command runs
+ */
+#define TIMING_END(phase, start)                              \
+    do                                                        \
+    {                                                         \
+        if (timing && (start) != 0)                           \
+        {                                                     \
+            phases.ns[(phase)] += monotonic_ns() - (start);   \
+            phases.n[(phase)]++;                              \
+        }                                                     \
+    } while (0)
+
+/*
+ * Macro:  TIMING_COUNT
+ * --------------------
+ * Counts an event (a field of struct phase_times) if a time command runs
+ */
+#define TIMING_COUNT(field)     \
+    do                          \
+    {                           \
+        if (timing)             \
+            phases.field++;     \
+    } while (0)
+
+int time_command(char *args[], int n_args);
+
+#endif
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tokenizer.h"
+
+void grow_tokens(struct token_list *t);
+void add_word(struct token_list *t, char *word, int len);
+
+char pipe_word[] = "|"; // Word standing for '|' (pipelines), shared so it can be told apart from other words
+
+/*
+ * Function:  init_tokens
+ * --------------------
+ * Initializes an empty token list using its inline storage (no allocation)
+ */
+void init_tokens(struct token_list *t)
+{
+    t->words = t->inline_words;
+    t->lens = t->inline_lens;
+    t->n = 0;
+    t->cap = INLINE_WORDS;
+}
+
+/*
+ * Function:  free_tokens
+ * --------------------
+ * Frees the heap storage of a token list (if it ever outgrew its inline storage) and resets it
+ */
+void free_tokens(struct token_list *t)
+{
+    if (t->words != t->inline_words)
+    {
+        free(t->words);
+        free(t->lens);
+    }
+    init_tokens(t);
+}
+
+/*
+ * Function:  grow_tokens
+ * --------------------
+ * Doubles the capacity of a token list, moving it to the heap
+ */
+void grow_tokens(struct token_list *t)
+{
+    char **words = malloc(2 * t->cap * sizeof(char *));
+    int *lens = malloc(2 * t->cap * sizeof(int));
+    if (words == NULL || lens == NULL)
+    {
+        perror("Unable to allocate words");
+        exit(1);
+    }
+    memcpy(words, t->words, t->n * sizeof(char *));
+    memcpy(lens, t->lens, t->n * sizeof(int));
+
+    if (t->words != t->inline_words)
+    {
+        free(t->words);
+        free(t->lens);
+    }
+    t->words = words;
+    t->lens = lens;
+    t->cap *= 2;
+}
+
+/*
+ * Function:  add_word
+ * --------------------
+ * Appends a word to a token list
+ */
+void add_word(struct token_list *t, char *word, int len)
+{
+    if (t->n == t->cap)
+        grow_tokens(t);
+
+    t->words[t->n] = word;
+    t->lens[t->n] = len;
+    t->n++;
+}
+
+/*
+ * Function:  is_pipe
+ * --------------------
+ * returns (int): Indicator (1 if the word is the '|' separating the stages of a pipeline, 0 otherwise)
+ */
+int is_pipe(const char *word)
+{
+    return word == pipe_word;
+}
+
+/*
+ * Function:  next_command
+ * --------------------
+ * Reads the words of the next command in buffer (commands end at '\n', ';' or the end of the buffer).
+ * Words are separated by spaces, extra spaces and tabs between words are ignored.
+ * '|' is a word of its own even without spaces around it (see is_pipe).
+ *
+ * Words are not copied: the character ending each word is overwritten with '\0' and t holds pointers into buffer,
+ * so buffer must be writable and must outlive the words. Nothing is allocated unless the command has more than
+ * INLINE_WORDS words, and words have no length limit.
+ *
+ * char *buffer: line buffer to read from (modified in place)
+ * int *buff_pos: current position in buffer to read at (moved past the command)
+ * struct token_list *t: filled with the words of the command
+ *
+ * returns (int): Number of words read (or -1 if the end of buffer was reached)
+ */
+int next_command(char *buffer, int *buff_pos, struct token_list *t)
+{
+    int pos = *buff_pos;
+    char c = buffer[pos];
+
+    t->n = 0;
+
+    // Indicate the end of the buffer has been reached
+    if (c == '\0')
+        return -1;
+
+    // Ignore leading whitespace
+    while (c == ' ' || c == '\t')
+        c = buffer[++pos];
+
+    // Each iter reads a word
+    do
+    {
+        if (c == '|')
+        {
+            add_word(t, pipe_word, 1);
+            c = buffer[++pos];
+        }
+        else
+        {
+            int start = pos;
+            while (c != '\0' && c != ' ' && c != '\n' && c != ';' && c != '|')
+                c = buffer[++pos];
+
+            add_word(t, buffer + start, pos - start);
+
+            // Terminate the word in place (c keeps the character it ended at)
+            if (c != '\0')
+                buffer[pos] = '\0';
+        }
+
+        // Ignore trailing whitespace (between words/after last word)
+        while (c == ' ' || c == '\t')
+            c = buffer[++pos];
+
+    } while (c != '\0' && c != '\n' && c != ';');
+
+    if (c != '\0')
+        ++pos;
+
+    *buff_pos = pos;
+    return t->n;
+}
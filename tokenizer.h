@@ -0,0 +1,21 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#define INLINE_WORDS 100 // Number of words a token list holds without allocating (grows to the heap beyond)
+
+struct token_list // Words of one command, as slices of the line they were read from
+{
+    char **words; // words[i] points into the line buffer (NUL terminated in place)
+    int *lens;    // lens[i] is the length of words[i]
+    int n;        // Number of words
+    int cap;      // Capacity of words and lens
+    char *inline_words[INLINE_WORDS];
+    int inline_lens[INLINE_WORDS];
+};
+
+void init_tokens(struct token_list *t);
+void free_tokens(struct token_list *t);
+int next_command(char *buffer, int *buff_pos, struct token_list *t);
+int is_pipe(const char *word);
+
+#endif
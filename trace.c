@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "output.h"
+#include "clock.h"
+
+// Variables defined in makefile
+// TRACEBUFSIZE, VICTIMTRACE
+
+#define TRACE_ON "on"
+#define TRACE_OFF "off"
+#define TRACE_CSV_EXTENSION ".csv" // Dumps to files with this extension are CSV, others are Chrome trace JSON
+
+struct trace_record // Event of the trace buffer
+{
+    long long ts;           // Time of the event (ns, monotonic clock)
+    unsigned long long pid; // Process the event is about
+    long long arg;          // Event specific value (see trace_type_t)
+    trace_type_t type;
+};
+
+struct trace_state // Ring buffer of the most recent TRACEBUFSIZE events
+{
+    struct trace_record events[TRACEBUFSIZE];
+    unsigned long long n; // Number of events recorded since the buffer was cleared (the buffer keeps the last ones)
+    int victims;          // Indicator (1 if evicted pages are printed, see trace_victims)
+} t_state = {.n = 0, .victims = VICTIMTRACE};
+
+int tracing = 0;
+
+const char *trace_names[] = {"fault", "page-in", "evict", "enqueue", "dequeue", "preempt", "exit"}; // By trace_type_t
+
+int trace_dump(const char *file);
+void dump_csv(FILE *f, unsigned long long first);
+void dump_chrome(FILE *f, unsigned long long first);
+int badcommandTrace();
+int error_trace_dump_failed(const char *file);
+
+/*
+ * Function:  trace_event
+ * --------------------
+ * Records an event in the ring buffer, overwriting the oldest event once it is full.
+ * The shell is single threaded, so the buffer needs no locking. Use TRACE_EVENT, which skips the call when tracing
+ * is off.
+ *
+ * trace_type_t type: kind of event
+ * unsigned long long pid: process the event is about
+ * long long arg: event specific value (see trace_type_t)
+ */
+void trace_event(trace_type_t type, unsigned long long pid, long long arg)
+{
+    struct trace_record *r = &t_state.events[t_state.n++ % TRACEBUFSIZE];
+    r->ts = monotonic_ns();
+    r->pid = pid;
+    r->arg = arg;
+    r->type = type;
+}
+
+/*
+ * Function:  trace_victims
+ * --------------------
+ * Indicates if the contents of evicted pages are printed (the victim page sink, off unless turned on with
+ * "trace victims on" or built with victimtrace=1)
+ *
+ * returns (int): Indicator (1 if victim pages are printed, 0 otherwise)
+ */
+int trace_victims()
+{
+    return t_state.victims;
+}
+
+/*
+ * Function:  trace
+ * --------------------
+ * trace builtin:
+ *   trace on|off            starts/stops recording events
+ *   trace clear             forgets recorded events
+ *   trace dump FILE         writes the recorded events to FILE (CSV if FILE ends with .csv, Chrome trace JSON otherwise,
+ *                           which chrome://tracing and Perfetto open)
+ *   trace victims on|off    prints the contents of evicted pages or not
+ *
+ * char *args[]: arguments (without the command name)
+ * int n_args: number of arguments
+ *
+ * returns (int): status
+ */
+int trace(char *args[], int n_args)
+{
+    if (n_args == 1 && strcmp(args[0], TRACE_ON) == 0)
+        tracing = 1;
+    else if (n_args == 1 && strcmp(args[0], TRACE_OFF) == 0)
+        tracing = 0;
+    else if (n_args == 1 && strcmp(args[0], "clear") == 0)
+        t_state.n = 0;
+    else if (n_args == 2 && strcmp(args[0], "dump") == 0)
+        return trace_dump(args[1]);
+    else if (n_args == 2 && strcmp(args[0], "victims") == 0 && strcmp(args[1], TRACE_ON) == 0)
+        t_state.victims = 1;
+    else if (n_args == 2 && strcmp(args[0], "victims") == 0 && strcmp(args[1], TRACE_OFF) == 0)
+        t_state.victims = 0;
+    else
+        return badcommandTrace();
+
+    return 0;
+}
+
+/*
+ * Function:  trace_dump
+ * --------------------
+ * Writes the events in the buffer to a file, oldest first
+ *
+ * const char *file: file to write (CSV if its name ends with .csv, Chrome trace JSON otherwise)
+ *
+ * returns (int): status
+ */
+int trace_dump(const char *file)
+{
+    FILE *f = fopen(file, "w");
+    if (f == NULL)
+        return error_trace_dump_failed(file);
+
+    unsigned long long first = t_state.n > TRACEBUFSIZE ? t_state.n - TRACEBUFSIZE : 0; // Older events were overwritten
+
+    size_t len = strlen(file), ext_len = strlen(TRACE_CSV_EXTENSION);
+    if (len >= ext_len && strcmp(file + len - ext_len, TRACE_CSV_EXTENSION) == 0)
+        dump_csv(f, first);
+    else
+        dump_chrome(f, first);
+
+    if (fclose(f) != 0)
+        return error_trace_dump_failed(file);
+    return 0;
+}
+
+/*
+ * Function:  dump_csv
+ * --------------------
+ * Writes events first..n-1 as CSV (time in ns relative to the first event)
+ */
+void dump_csv(FILE *f, unsigned long long first)
+{
+    long long start = first < t_state.n ? t_state.events[first % TRACEBUFSIZE].ts : 0;
+
+    fprintf(f, "ts_ns,event,pid,arg\n");
+    for (unsigned long long i = first; i < t_state.n; i++)
+    {
+        struct trace_record *r = &t_state.events[i % TRACEBUFSIZE];
+        fprintf(f, "%lld,%s,%llu,%lld\n", r->ts - start, trace_names[r->type], r->pid, r->arg);
+    }
+}
+
+/*
+ * Function:  dump_chrome
+ * --------------------
+ * Writes events first..n-1 in the Chrome trace event format. Every process is a thread of the shell, and the time it
+ * runs (from dequeue to preempt, fault or exit) is shown as a "run" slice; every event is also an instant event.
+ */
+void dump_chrome(FILE *f, unsigned long long first)
+{
+    long long start = first < t_state.n ? t_state.events[first % TRACEBUFSIZE].ts : 0;
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    for (unsigned long long i = first; i < t_state.n; i++)
+    {
+        struct trace_record *r = &t_state.events[i % TRACEBUFSIZE];
+        double us = (r->ts - start) / 1000.0;
+
+        if (r->type == TRACE_PREEMPT || r->type == TRACE_FAULT || r->type == TRACE_EXIT)
+            fprintf(f, "{\"name\":\"run\",\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%llu},\n", us, r->pid);
+
+        fprintf(f, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%llu,\"args\":{\"arg\":%lld}}",
+                trace_names[r->type], us, r->pid, r->arg);
+
+        if (r->type == TRACE_DEQUEUE)
+            fprintf(f, ",\n{\"name\":\"run\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%llu}", us, r->pid);
+
+        fprintf(f, i + 1 < t_state.n ? ",\n" : "\n");
+    }
+    fprintf(f, "],\"displayTimeUnit\":\"ns\"}\n");
+}
+
+/*
+ * Function:  badcommandTrace
+ * --------------------
+ * Indicates that trace was given arguments it does not understand
+ *
+ * returns (int): status
+ */
+int badcommandTrace()
+{
+    out_printf("%s\n", "Bad command: Expected trace on|off|clear|dump FILE|victims on|off");
+    return 15;
+}
+
+/*
+ * Function:  error_trace_dump_failed
+ * --------------------
+ * Prints error when the trace could not be written
+ *
+ * returns (int): status
+ */
+int error_trace_dump_failed(const char *file)
+{
+    out_printf("Error: Failed to write trace to %s\n", file);
+    return 16;
+}
@@ -0,0 +1,33 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+typedef enum // Kinds of trace events (see trace_event)
+{
+    TRACE_FAULT,   // Process blocked because its next page is not resident (arg: page)
+    TRACE_PAGE_IN, // Page loaded into a frame (arg: page)
+    TRACE_EVICT,   // Page evicted from its frame (arg: page)
+    TRACE_ENQUEUE, // Process added to the ready queue (arg: key)
+    TRACE_DEQUEUE, // Process taken from the ready queue to run (arg: key)
+    TRACE_PREEMPT, // Running process put back into the ready queue (arg: key)
+    TRACE_EXIT     // Process terminated (arg: pc)
+} trace_type_t;
+
+extern int tracing; // Indicator (1 while events are recorded), read directly by TRACE_EVENT
+
+/*
+ * Macro:  TRACE_EVENT
+ * --------------------
+ * Records an event if tracing is on. When it is off this is a single test of a global, nothing else is evaluated.
+ */
+#define TRACE_EVENT(type, pid, arg)            \
+    do                                         \
+    {                                          \
+        if (tracing)                           \
+            trace_event((type), (pid), (arg)); \
+    } while (0)
+
+void trace_event(trace_type_t type, unsigned long long pid, long long arg);
+int trace_victims();
+int trace(char *args[], int n_args);
+
+#endif